@@ -0,0 +1,52 @@
+// Benchmarks of the server internals, without the HTTP layer, MySQL or Telegram. Every mode runs in
+// a fresh temporary directory that is removed afterwards.
+//
+//   ArchivioVideoBench videos_data [messages]
+//       get_videos_data before and after the set-based lookup: one telegram_video plus one video
+//       query per item (the old handler) against select_latest_videos, for 100 and 1000 items
+//
+//   ArchivioVideoBench indexes [rows]
+//       the lookups the migrations add indexes for, on the base schema (primary keys only) and
+//       again after run_migrations(), with the query plan SQLite picked
+//
+//   ArchivioVideoBench upload [uploads] [size_mb]
+//       parallel uploads through the chunk path of handle_upload, against the old buffered
+//       body + ofstream-per-chunk path: sustained MB/s and peak resident memory
+//
+//   ArchivioVideoBench staging [uploads] [size_mb]
+//       the staging layer alone, direct I/O off and on: how much of a video streamed meanwhile
+//       stays in the page cache while the staging files are written (Linux only)
+
+#include "bench.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <random>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    if(mode != "videos_data" && mode != "indexes" && mode != "upload" && mode != "staging"){
+        std::cerr << "Usage: " << argv[0] << " videos_data|indexes [rows]" << std::endl
+                  << "       " << argv[0] << " upload|staging [uploads] [size_mb]" << std::endl;
+        return 2;
+    }
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("archivio_bench_" + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir);
+    std::filesystem::current_path(dir);
+
+    int status;
+    if(mode == "upload"){
+        status = bench_upload(argc > 2 ? std::stoul(argv[2]) : 16, argc > 3 ? std::stoull(argv[3]) : 256);
+    }else if(mode == "staging"){
+        status = bench_staging(argc > 2 ? std::stoul(argv[2]) : 4, argc > 3 ? std::stoull(argv[3]) : 2048);
+    }else{
+        status = bench_db(mode, argc > 2 ? std::stoll(argv[2]) : mode == "indexes" ? 1000000 : 200000);
+    }
+
+    std::filesystem::current_path(dir.parent_path());
+    std::filesystem::remove_all(dir);
+    return status;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Modes of ArchivioVideoBench, each run from a fresh temporary directory (see bench.cpp)
+using bench_clock = std::chrono::steady_clock;
+
+inline double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// "videos_data" or "indexes", on a throwaway SQLite database of `rows` rows
+extern int bench_db(const std::string& mode, int64_t rows);
+
+// `uploads` parallel clients sending `size_mb` MB each through the upload chunk path
+extern int bench_upload(unsigned int uploads, uint64_t size_mb);
+
+// `uploads` staging files of `size_mb` MB written while a cached video is read, direct I/O off and on
+extern int bench_staging(unsigned int uploads, uint64_t size_mb);
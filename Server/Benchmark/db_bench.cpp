@@ -0,0 +1,199 @@
+// Metadata query modes of ArchivioVideoBench, on the SQLite backend: no MySQL server or Telegram
+// session needed.
+
+#include "bench.hpp"
+#include "db.hpp"
+#include "migrations.hpp"
+#include "video_query.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <functional>
+
+inline constexpr int64_t BENCH_CHATS = 4;
+inline constexpr int BENCH_RUNS = 25;
+
+// Runs `body` BENCH_RUNS times after one warm-up call and prints the median and the worst run
+static void report(const std::string& label, const std::function<size_t()>& body)
+{
+    size_t found = body();
+    std::vector<double> runs;
+    for(int i = 0; i < BENCH_RUNS; i++){
+        auto start = bench_clock::now();
+        found = body();
+        runs.push_back(elapsed_ms(start));
+    }
+
+    std::sort(runs.begin(), runs.end());
+    std::cout << std::left << std::setw(34) << label << std::right << std::fixed << std::setprecision(2)
+              << " median " << std::setw(9) << runs[runs.size() / 2] << " ms"
+              << "   max " << std::setw(9) << runs.back() << " ms"
+              << "   (" << found << " rows)" << std::endl;
+}
+
+static bool run(const std::string& sql, const std::vector<DbValue>& params = {})
+{
+    if(!db_query(sql, params).ok){
+        std::cerr << "[ERROR] " << sql << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// `rows` telegram_video rows spread over BENCH_CHATS chats (telegram_video.id == n), one video per
+// message plus a newer version for every third one, and one image per video
+static bool seed(int64_t rows)
+{
+    const std::string seq = "WITH RECURSIVE seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < ?) ";
+
+    auto start = bench_clock::now();
+    bool ok = run("INSERT INTO telegram_video(message_id, chat_id) " + seq +
+                  "SELECT (n - 1) / " + std::to_string(BENCH_CHATS) + " + 1, (n - 1) % " + std::to_string(BENCH_CHATS) + " + 1 FROM seq;", { rows })
+           && run("INSERT INTO video(title, description, data_caricamento, telegram_video_id) " + seq +
+                  "SELECT 'Video ' || n, 'Descrizione del video ' || n, '2024-01-01', n FROM seq;", { rows })
+           && run("INSERT INTO video(title, description, data_caricamento, telegram_video_id) " + seq +
+                  "SELECT 'Video ' || n || ' v2', 'Descrizione aggiornata ' || n, '2024-06-01', n FROM seq WHERE n % 3 = 0;", { rows })
+           && run("INSERT INTO image(original_filename, saved_filename) " + seq +
+                  "SELECT 'IMG_' || n || '.jpg', 'image_' || n || '.jpg' FROM seq;", { rows });
+
+    std::cout << "Seeded " << rows << " telegram_video/image rows and " << rows + rows / 3
+              << " video rows in " << std::setprecision(0) << std::fixed << elapsed_ms(start) << " ms" << std::endl;
+    return ok;
+}
+
+// Message ids of one page of a chat listing, starting at a random message
+static std::vector<int64_t> page(std::mt19937_64& rng, int64_t messages, size_t items)
+{
+    std::uniform_int_distribution<int64_t> first(1, messages - int64_t(items));
+    std::vector<int64_t> ids;
+    for(int64_t id = first(rng); ids.size() < items; id++){
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+// What get_videos_data_handler did per item before the set-based lookup
+static size_t select_per_item(int64_t chat_id, const std::vector<int64_t>& message_ids)
+{
+    size_t found = 0;
+    for(int64_t message_id : message_ids){
+        json telegram_video = db_select("SELECT * FROM telegram_video WHERE chat_id = " + std::to_string(chat_id) +
+                                        " AND message_id = " + std::to_string(message_id) + ";");
+        if(telegram_video.empty()){
+            continue;
+        }
+
+        json video = db_select("SELECT * FROM video WHERE telegram_video_id = " + telegram_video[0]["id"].get<std::string>() + " ORDER BY id DESC;");
+        if(!video.empty()){
+            found++;
+        }
+    }
+    return found;
+}
+
+static int bench_videos_data(int64_t rows)
+{
+    if(!seed(rows) || run_migrations() != 0){
+        return 1;
+    }
+
+    std::mt19937_64 rng(42);
+    int64_t messages = rows / BENCH_CHATS;
+
+    for(size_t items : { size_t(100), size_t(1000) }){
+        std::vector<int64_t> ids = page(rng, messages, items);
+
+        report(std::to_string(items) + " items, per-item queries", [&]{
+            return select_per_item(1, ids);
+        });
+        report(std::to_string(items) + " items, select_latest_videos", [&]{
+            std::unordered_map<int64_t, json> latest;
+            select_latest_videos(1, ids, latest);
+            return latest.size();
+        });
+    }
+    return 0;
+}
+
+struct Lookup {
+    std::string label;
+    std::string sql;
+    std::function<std::vector<DbValue>(int64_t n)> params; // of the n-th seeded row
+};
+
+static std::string query_plan(const Lookup& lookup)
+{
+    DbResult plan = db_query("EXPLAIN QUERY PLAN " + lookup.sql, lookup.params(1));
+    std::string detail;
+    for(const DbRow& row : plan.rows){
+        detail += (detail.empty() ? "" : "; ") + db_string(row.back());
+    }
+    return detail;
+}
+
+// Average time of `count` lookups of random seeded rows
+static void time_lookups(const Lookup& lookup, int64_t rows, int count, std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int64_t> row(1, rows);
+    size_t found = 0;
+
+    auto start = bench_clock::now();
+    for(int i = 0; i < count; i++){
+        DbResult result = db_query(lookup.sql, lookup.params(row(rng)));
+        found += result.rows.size();
+    }
+    double total = elapsed_ms(start);
+
+    std::cout << std::left << std::setw(30) << lookup.label << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << total * 1000.0 / count << " us/lookup   (" << count << " lookups, " << found << " rows)" << std::endl
+              << "    " << query_plan(lookup) << std::endl;
+}
+
+static int bench_indexes(int64_t rows)
+{
+    if(!seed(rows)){
+        return 1;
+    }
+
+    const std::vector<Lookup> lookups = {
+        { "telegram_video by message", "SELECT * FROM telegram_video WHERE chat_id = ? AND message_id = ?;",
+          [](int64_t n) { return std::vector<DbValue>{ (n - 1) % BENCH_CHATS + 1, (n - 1) / BENCH_CHATS + 1 }; } },
+        { "latest video of a message", "SELECT * FROM video WHERE telegram_video_id = ? ORDER BY id DESC LIMIT 1;",
+          [](int64_t n) { return std::vector<DbValue>{ n }; } },
+        { "image by saved_filename", "SELECT id FROM image WHERE saved_filename = ?;",
+          [](int64_t n) { return std::vector<DbValue>{ "image_" + std::to_string(n) + ".jpg" }; } }
+    };
+
+    std::mt19937_64 rng(42);
+
+    std::cout << "\nBase schema" << std::endl;
+    for(const Lookup& lookup : lookups){
+        time_lookups(lookup, rows, 20, rng);
+    }
+
+    auto start = bench_clock::now();
+    if(run_migrations() != 0){
+        return 1;
+    }
+    std::cout << "Migrations took " << std::setprecision(0) << elapsed_ms(start) << " ms" << std::endl;
+
+    std::cout << "\nAfter migrations" << std::endl;
+    for(const Lookup& lookup : lookups){
+        time_lookups(lookup, rows, 20000, rng);
+    }
+    return 0;
+}
+
+int bench_db(const std::string& mode, int64_t rows)
+{
+    if(connect_db() != 0){
+        return 1;
+    }
+
+    int status = mode == "indexes" ? bench_indexes(rows) : bench_videos_data(rows);
+    disconnect_db();
+    return status;
+}
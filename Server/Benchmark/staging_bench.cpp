@@ -0,0 +1,216 @@
+// Staging mode of ArchivioVideoBench: how much of the page cache the staging layer alone takes away
+// from a video being streamed at the same time. Parallel writers fill staging files through
+// staging_open + ChunkWriter while one reader keeps streaming a cached "hot" file, once with direct
+// I/O off and once with it on; after each pass mincore() tells how much of either is still cached.
+
+#include "bench.hpp"
+#include "staging.hpp"
+#include "io_engine.hpp"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+inline constexpr uint64_t STAGING_BENCH_CHUNK = 1024 * 1024; // UploadActivity's CHUNK_SIZE
+inline constexpr size_t STAGING_BENCH_PIECE = 16384;         // CPPHTTPLIB_RECV_BUFSIZ
+inline constexpr uint64_t STAGING_BENCH_HOT_SIZE = 512 * 1024 * 1024;
+inline constexpr size_t STAGING_BENCH_READ = 1024 * 1024;    // one streamed range
+
+#ifdef __linux__
+
+// "Cached:" of /proc/meminfo in KB
+static uint64_t cached_kb()
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    uint64_t value = 0;
+    while(meminfo >> key >> value){
+        if(key == "Cached:"){
+            return value;
+        }
+        meminfo.ignore(64, '\n');
+    }
+    return 0;
+}
+
+// Fraction of the pages of `path` that are in the page cache
+static double resident_fraction(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return 0;
+    }
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    double fraction = 0;
+    void* map = size > 0 ? mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if(map != MAP_FAILED){
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> pages((static_cast<size_t>(size) + page - 1) / page);
+        if(mincore(map, static_cast<size_t>(size), pages.data()) == 0){
+            size_t resident = std::count_if(pages.begin(), pages.end(), [](unsigned char p) { return p & 1; });
+            fraction = static_cast<double>(resident) / pages.size();
+        }
+        munmap(map, static_cast<size_t>(size));
+    }
+
+    ::close(fd);
+    return fraction;
+}
+
+// Reads the whole file through the cache; returns the bytes read
+static uint64_t read_file(int fd, uint64_t size, std::vector<char>& buffer)
+{
+    uint64_t total = 0;
+    for(uint64_t offset = 0; offset < size; offset += buffer.size()){
+        ssize_t n = pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+        if(n <= 0){
+            break;
+        }
+        total += static_cast<uint64_t>(n);
+    }
+    return total;
+}
+
+// One upload's worth of ChunkWriter calls, chunk after chunk in socket-sized pieces
+static bool write_staging(const std::string& path, uint64_t size, const std::string& body, bool direct_io)
+{
+    StagingFile file;
+    if(!staging_open(file, path, size, direct_io)){
+        return false;
+    }
+
+    bool ok = true;
+    for(uint64_t start = 0; ok && start < size; start += STAGING_BENCH_CHUNK){
+        uint64_t end = std::min(size, start + STAGING_BENCH_CHUNK);
+        ChunkWriter writer(file, start);
+        for(uint64_t offset = start; ok && offset < end; offset += STAGING_BENCH_PIECE){
+            size_t length = static_cast<size_t>(std::min<uint64_t>(STAGING_BENCH_PIECE, end - offset));
+            ok = writer.write(body.data() + (offset - start), length);
+        }
+        ok = ok && writer.flush();
+    }
+
+    staging_close(file);
+    return ok;
+}
+
+static bool run_pass(bool direct_io, unsigned int uploads, uint64_t size, const std::string& body, const std::string& hot_path)
+{
+    int hot_fd = ::open(hot_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(hot_fd < 0){
+        return false;
+    }
+
+    // Every pass starts from a fully cached hot file
+    std::vector<char> buffer(STAGING_BENCH_READ);
+    read_file(hot_fd, STAGING_BENCH_HOT_SIZE, buffer);
+    double hot_before = resident_fraction(hot_path);
+    uint64_t cached_before = cached_kb();
+
+    std::atomic<bool> writing = true;
+    std::atomic<unsigned int> failures = 0;
+    uint64_t streamed = 0;
+
+    auto start = bench_clock::now();
+    std::thread reader([&]{
+        while(writing){
+            streamed += read_file(hot_fd, STAGING_BENCH_HOT_SIZE, buffer);
+        }
+    });
+
+    std::vector<std::thread> writers;
+    for(unsigned int i = 0; i < uploads; i++){
+        writers.emplace_back([&, i]{
+            if(!write_staging("tmp/bench_staging_" + std::to_string(i) + ".mp4", size, body, direct_io)){
+                failures++;
+            }
+        });
+    }
+    for(std::thread& writer : writers){
+        writer.join();
+    }
+
+    double seconds = elapsed_ms(start) / 1000.0;
+    writing = false;
+    reader.join();
+    ::close(hot_fd);
+
+    double staging_resident = 0;
+    for(unsigned int i = 0; i < uploads; i++){
+        staging_resident += resident_fraction("tmp/bench_staging_" + std::to_string(i) + ".mp4") / uploads;
+    }
+    double hot_after = resident_fraction(hot_path);
+    int64_t cached_delta = static_cast<int64_t>(cached_kb()) - static_cast<int64_t>(cached_before);
+    double total_mb = static_cast<double>(size) * uploads / (1024 * 1024);
+
+    std::cout << (direct_io ? "direct I/O on " : "direct I/O off") << std::fixed << std::setprecision(1)
+              << "   writes " << std::setw(7) << total_mb / seconds << " MB/s"
+              << "   reader " << std::setw(7) << streamed / (1024.0 * 1024.0) / seconds << " MB/s"
+              << "   hot file cached " << std::setw(5) << hot_before * 100 << "% -> " << std::setw(5) << hot_after * 100 << "%"
+              << "   staging cached " << std::setw(5) << staging_resident * 100 << "%"
+              << "   Cached " << std::showpos << cached_delta / 1024 << std::noshowpos << " MB";
+    if(failures){
+        std::cout << "   (" << failures << " failed)";
+    }
+    std::cout << std::endl;
+
+    for(unsigned int i = 0; i < uploads; i++){
+        std::error_code ec;
+        std::filesystem::remove("tmp/bench_staging_" + std::to_string(i) + ".mp4", ec);
+    }
+    return failures == 0;
+}
+
+int bench_staging(unsigned int uploads, uint64_t size_mb)
+{
+    std::filesystem::create_directories("tmp");
+    start_io_engine();
+
+    std::string body(STAGING_BENCH_CHUNK, '\0');
+    std::mt19937_64 rng(42);
+    for(size_t i = 0; i + sizeof(uint64_t) <= body.size(); i += sizeof(uint64_t)){
+        uint64_t value = rng();
+        std::memcpy(&body[i], &value, sizeof(value));
+    }
+
+    const std::string hot_path = "hot_video.mp4";
+    {
+        std::ofstream hot(hot_path, std::ios::binary | std::ios::trunc);
+        for(uint64_t written = 0; written < STAGING_BENCH_HOT_SIZE; written += body.size()){
+            hot.write(body.data(), body.size());
+        }
+    }
+
+    uint64_t size = size_mb * 1024 * 1024;
+    std::cout << uploads << " staging files of " << size_mb << " MB (direct I/O from " << STAGING_DIRECT_IO_MIN_SIZE / (1024 * 1024)
+              << " MB) while a " << STAGING_BENCH_HOT_SIZE / (1024 * 1024) << " MB video is streamed, I/O engine " << io_engine_name() << std::endl;
+
+    bool ok = run_pass(false, uploads, size, body, hot_path)
+           && run_pass(true, uploads, size, body, hot_path);
+
+    stop_io_engine();
+    return ok ? 0 : 1;
+}
+
+#else
+
+int bench_staging(unsigned int, uint64_t)
+{
+    std::cerr << "[ERROR] The staging benchmark needs mincore() and /proc/meminfo (Linux)" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,219 @@
+// Upload mode of ArchivioVideoBench: the chunk path of handle_upload without the HTTP layer. Each
+// thread is one client sending its file in order, one chunk per request, and every chunk body
+// arrives in socket-sized pieces like httplib's ContentReader hands them over.
+
+#include "bench.hpp"
+#include "upload.hpp"
+#include "staging.hpp"
+#include "io_engine.hpp"
+#include "crc32c.hpp"
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+inline constexpr uint64_t UPLOAD_BENCH_CHUNK = 1024 * 1024; // UploadActivity's CHUNK_SIZE
+inline constexpr size_t UPLOAD_BENCH_PIECE = 16384;         // CPPHTTPLIB_RECV_BUFSIZ
+inline constexpr auto RSS_SAMPLE_INTERVAL = std::chrono::milliseconds(10);
+
+// Resident set size in KB; 0 where /proc is not available
+static uint64_t resident_kb()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+#else
+    return 0;
+#endif
+}
+
+// Samples the resident set size while one phase runs and keeps the highest value
+class RssSampler{
+public:
+    RssSampler() : thread([this]{
+        while(!stopping){
+            peak_kb = std::max<uint64_t>(peak_kb, resident_kb());
+            std::this_thread::sleep_for(RSS_SAMPLE_INTERVAL);
+        }
+    }) {}
+
+    uint64_t stop()
+    {
+        stopping = true;
+        thread.join();
+        return std::max<uint64_t>(peak_kb, resident_kb());
+    }
+
+private:
+    std::atomic<bool> stopping = false;
+    std::atomic<uint64_t> peak_kb = 0;
+    std::thread thread;
+};
+
+// The chunk loop of handle_upload: claim, ChunkWriter + ChunkHasher fed piece by piece with the
+// CRC-32C check, then upload_mark_received. `body` holds the bytes of one full chunk.
+// Without `verify` the CRC and the content hash are skipped, leaving the cost of the writes.
+static bool send_streaming(const std::string& path, uint64_t size, const std::string& body, bool verify)
+{
+    std::shared_ptr<UploadFile> upload = open_upload(path, size);
+    if(!upload){
+        return false;
+    }
+
+    const uint32_t full_chunk_crc = crc32c(0, body.data(), body.size());
+    char piece[UPLOAD_BENCH_PIECE];
+    bool ok = true;
+
+    for(uint64_t start = 0; ok && start < size; start += UPLOAD_BENCH_CHUNK){
+        uint64_t end = std::min(size, start + UPLOAD_BENCH_CHUNK);
+        uint32_t checksum = end - start == body.size() ? full_chunk_crc : crc32c(0, body.data(), end - start);
+
+        if(upload_claim_chunk(*upload, start, end, checksum) != ChunkCheck::Missing){
+            ok = false;
+            break;
+        }
+
+        StagingFileUse file_use(*upload);
+        ChunkWriter writer(upload->file, start);
+        ChunkHasher hasher(*upload, start);
+        uint32_t crc = 0;
+
+        for(uint64_t offset = start; ok && offset < end; offset += UPLOAD_BENCH_PIECE){
+            size_t length = static_cast<size_t>(std::min<uint64_t>(UPLOAD_BENCH_PIECE, end - offset));
+            std::memcpy(piece, body.data() + (offset - start), length); // the socket read
+            ok = writer.write(piece, length);
+            if(verify){
+                crc = crc32c(crc, piece, length);
+                hasher.update(piece, length);
+            }
+        }
+
+        if(!ok || !writer.flush() || (verify && crc != checksum)){
+            upload_release_chunk(*upload, start);
+            ok = false;
+            break;
+        }
+
+        if(verify){
+            hasher.commit();
+        }
+        upload_mark_received(*upload, start, end, checksum);
+    }
+
+    ok = ok && upload->completed && (!verify || !upload_content_hash(*upload).empty());
+    forget_upload(path);
+    upload.reset();
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return ok;
+}
+
+// handle_upload before the streaming handler: httplib collects the body in req.body, then the
+// chunk is written through a fresh ofstream; the file was made sparse by writing its last byte
+static bool send_buffered(const std::string& path, uint64_t size, const std::string& body)
+{
+    {
+        std::ofstream prealloc(path, std::ios::binary | std::ios::trunc);
+        prealloc.seekp(size - 1);
+        prealloc.write("", 1);
+    }
+
+    char piece[UPLOAD_BENCH_PIECE];
+    bool ok = true;
+
+    for(uint64_t start = 0; ok && start < size; start += UPLOAD_BENCH_CHUNK){
+        uint64_t end = std::min(size, start + UPLOAD_BENCH_CHUNK);
+
+        std::string request_body;
+        for(uint64_t offset = start; offset < end; offset += UPLOAD_BENCH_PIECE){
+            size_t length = static_cast<size_t>(std::min<uint64_t>(UPLOAD_BENCH_PIECE, end - offset));
+            std::memcpy(piece, body.data() + (offset - start), length);
+            request_body.append(piece, length);
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(start);
+        file.write(request_body.c_str(), request_body.size());
+        ok = static_cast<bool>(file);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return ok;
+}
+
+using SendFunction = std::function<bool(const std::string& path, uint64_t size, const std::string& body)>;
+
+static bool run_phase(const std::string& label, const SendFunction& send, unsigned int uploads, uint64_t size, const std::string& body)
+{
+    std::atomic<unsigned int> failures = 0;
+    std::vector<std::thread> clients;
+
+    RssSampler rss;
+    auto start = bench_clock::now();
+
+    for(unsigned int i = 0; i < uploads; i++){
+        clients.emplace_back([&, i]{
+            if(!send("tmp/bench_upload_" + std::to_string(i) + ".mp4", size, body)){
+                failures++;
+            }
+        });
+    }
+    for(std::thread& client : clients){
+        client.join();
+    }
+
+    double seconds = elapsed_ms(start) / 1000.0;
+    uint64_t peak_kb = rss.stop();
+    double total_mb = static_cast<double>(size) * uploads / (1024 * 1024);
+
+    std::cout << std::left << std::setw(28) << label << std::right << std::fixed << std::setprecision(1)
+              << std::setw(9) << total_mb / seconds << " MB/s   peak RSS " << std::setw(7) << peak_kb / 1024.0 << " MB"
+              << "   (" << total_mb << " MB in " << std::setprecision(2) << seconds << " s";
+    if(failures){
+        std::cout << ", " << failures << " failed";
+    }
+    std::cout << ")" << std::endl;
+    return failures == 0;
+}
+
+int bench_upload(unsigned int uploads, uint64_t size_mb)
+{
+    std::filesystem::create_directories("tmp");
+    start_io_engine();
+
+    std::string body(UPLOAD_BENCH_CHUNK, '\0');
+    std::mt19937_64 rng(42);
+    for(size_t i = 0; i + sizeof(uint64_t) <= body.size(); i += sizeof(uint64_t)){
+        uint64_t value = rng();
+        std::memcpy(&body[i], &value, sizeof(value));
+    }
+
+    uint64_t size = size_mb * 1024 * 1024;
+    std::cout << uploads << " parallel uploads of " << size_mb << " MB, " << UPLOAD_BENCH_CHUNK / 1024 << " KB chunks, I/O engine "
+              << io_engine_name() << ", idle RSS " << std::setprecision(1) << std::fixed << resident_kb() / 1024.0 << " MB" << std::endl;
+
+    auto verified = [](const std::string& path, uint64_t size, const std::string& body) { return send_streaming(path, size, body, true); };
+    auto writes_only = [](const std::string& path, uint64_t size, const std::string& body) { return send_streaming(path, size, body, false); };
+
+    bool ok = run_phase("streaming, CRC + SHA-256", verified, uploads, size, body)
+           && run_phase("streaming, writes only", writes_only, uploads, size, body)
+           && run_phase("buffered body + ofstream", send_buffered, uploads, size, body);
+
+    stop_io_engine();
+    return ok ? 0 : 1;
+}
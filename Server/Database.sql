@@ -4,11 +4,13 @@ USE ArchivioVideo;
 
 CREATE TABLE telegram_video(id int PRIMARY KEY AUTO_INCREMENT,
                             message_id bigint,
-                            chat_id bigint);
+                            chat_id bigint,
+                            UNIQUE KEY uq_telegram_video_message (chat_id, message_id));
 
 CREATE TABLE image(id int PRIMARY KEY AUTO_INCREMENT,
                    original_filename varchar(255),
-                   saved_filename varchar(255));
+                   saved_filename varchar(255),
+                   INDEX idx_image_saved_filename (saved_filename));
 
 CREATE TABLE video(id INT PRIMARY KEY AUTO_INCREMENT,
                    title varchar(255),
@@ -16,5 +18,10 @@ CREATE TABLE video(id INT PRIMARY KEY AUTO_INCREMENT,
                    data_caricamento date,
                    telegram_video_id int,
                    thumbnail_id int,
+                   INDEX idx_video_telegram_latest (telegram_video_id, id),
                    FOREIGN KEY(telegram_video_id) REFERENCES telegram_video(id),
-                   FOREIGN KEY(thumbnail_id) REFERENCES image(id));
\ No newline at end of file
+                   FOREIGN KEY(thumbnail_id) REFERENCES image(id));
+
+CREATE TABLE content_hash(hash char(64) PRIMARY KEY,
+                          remote_file_id varchar(255),
+                          size bigint);
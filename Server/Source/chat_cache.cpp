@@ -0,0 +1,172 @@
+#include "chat_cache.hpp"
+#include "random.hpp"
+
+// TDLib sends int64 fields as strings
+static int64_t to_int64(const json& value)
+{
+    if(value.is_string()){
+        try{
+            return std::stoll(value.get<std::string>());
+        }catch(const std::exception&){
+            return 0;
+        }
+    }
+    return value.is_number() ? value.get<int64_t>() : 0;
+}
+
+static bool is_main_list(const json& position)
+{
+    return position.contains("list") && position["list"].value("@type", "") == "chatListMain";
+}
+
+ChatListCache::ChatListCache() : epoch(rand_uint32())
+{
+}
+
+ChatListCache::SortKey ChatListCache::key(int64_t id, const Chat& chat) const
+{
+    return { -chat.order, chat.rank, id };
+}
+
+bool ChatListCache::listed(const Chat& chat) const
+{
+    return chat.positioned ? chat.order != 0 : chat.rank >= 0;
+}
+
+// Applies `change` to a chat, moving it in the sorted index when its position changes
+void ChatListCache::update(int64_t id, const std::function<void(Chat&)>& change)
+{
+    Chat& chat = chats[id];
+    bool was_listed = listed(chat);
+    SortKey old_key = key(id, chat);
+    Chat before = chat;
+
+    change(chat);
+
+    bool now_listed = listed(chat);
+    SortKey new_key = key(id, chat);
+
+    if(was_listed && (!now_listed || old_key != new_key)){
+        order.erase(old_key);
+    }
+    if(now_listed && (!was_listed || old_key != new_key)){
+        order.insert(new_key);
+    }
+
+    if(was_listed != now_listed || (now_listed && (old_key != new_key || before.title != chat.title || before.type != chat.type))){
+        version++;
+    }
+}
+
+// `positions` is the complete list of positions of the chat
+void ChatListCache::set_main_order(int64_t id, const json& positions)
+{
+    int64_t main_order = 0;
+    for(const auto& position : positions){
+        if(is_main_list(position)){
+            main_order = to_int64(position["order"]);
+        }
+    }
+
+    update(id, [&](Chat& chat){
+        chat.order = main_order;
+        chat.positioned = true;
+    });
+}
+
+void ChatListCache::apply(const json& object)
+{
+    std::string type = object.value("@type", "");
+    if(type.compare(0, 10, "updateChat") != 0 && type != "updateNewChat"){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(type == "updateNewChat"){
+        const json& chat = object["chat"];
+        int64_t id = to_int64(chat["id"]);
+
+        update(id, [&](Chat& cached){
+            cached.title = chat.value("title", "");
+            cached.type = chat.contains("type") ? chat["type"].value("@type", "") : "";
+        });
+
+        if(chat.contains("positions")){
+            set_main_order(id, chat["positions"]);
+        }
+    }
+    else if(type == "updateChatTitle"){
+        std::string title = object.value("title", "");
+        update(to_int64(object["chat_id"]), [&](Chat& chat){
+            chat.title = title;
+        });
+    }
+    else if(type == "updateChatPosition"){
+        const json& position = object["position"];
+        if(!is_main_list(position)){
+            return;
+        }
+
+        int64_t main_order = to_int64(position["order"]);
+        update(to_int64(object["chat_id"]), [&](Chat& chat){
+            chat.order = main_order;
+            chat.positioned = true;
+        });
+    }
+    else if(object.contains("positions") && object.contains("chat_id")){
+        // updateChatLastMessage, updateChatDraftMessage: they carry all the positions of the chat
+        set_main_order(to_int64(object["chat_id"]), object["positions"]);
+    }
+}
+
+void ChatListCache::load(const std::vector<json>& loaded_chats)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for(size_t i = 0; i < loaded_chats.size(); i++){
+        const json& loaded = loaded_chats[i];
+        int64_t rank = static_cast<int64_t>(i);
+
+        update(to_int64(loaded["id"]), [&](Chat& chat){
+            chat.rank = rank;
+            if(chat.title.empty()){
+                chat.title = loaded.value("title", "");
+            }
+            if(chat.type.empty()){
+                chat.type = loaded.value("type", "");
+            }
+        });
+    }
+
+    is_loaded = true;
+    version++;
+}
+
+bool ChatListCache::loaded()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return is_loaded;
+}
+
+std::pair<std::string, std::string> ChatListCache::snapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(built_version != version){
+        json list = json::array();
+        for(const auto& [negative_order, rank, id] : order){
+            const Chat& chat = chats[id];
+            list.push_back({
+                {"id", id},
+                {"title", chat.title},
+                {"type", chat.type}
+            });
+        }
+
+        body = list.dump();
+        built_version = version;
+    }
+
+    return { "\"" + std::to_string(epoch) + "-" + std::to_string(version) + "\"", body };
+}
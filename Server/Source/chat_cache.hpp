@@ -0,0 +1,59 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <set>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+using json = nlohmann::json;
+
+// Main chat list of one session, kept current by the TDLib update stream (updateNewChat,
+// updateChatTitle, updateChatPosition, ...). Each update costs O(log chats); the serialized
+// list is rebuilt only when a request finds it out of date.
+class ChatListCache{
+public:
+    ChatListCache();
+
+    // Applies a TDLib object received by the session; anything but chat updates is ignored
+    void apply(const json& object);
+
+    // Seeds the cache with a full get_chats() load. Chats whose position is still unknown keep
+    // the load order, after the positioned ones.
+    void load(const std::vector<json>& chats);
+    bool loaded();
+
+    // Serialized list with its ETag, which changes whenever the list does
+    std::pair<std::string, std::string> snapshot();
+
+private:
+    struct Chat {
+        std::string title;
+        std::string type;
+        int64_t order = 0;     // position in chatListMain, 0 = not in the list
+        bool positioned = false;
+        int64_t rank = -1;     // index in the last load, -1 if not loaded
+    };
+
+    // Sorted by descending order, then load rank
+    using SortKey = std::tuple<int64_t, int64_t, int64_t>;
+
+    SortKey key(int64_t id, const Chat& chat) const;
+    bool listed(const Chat& chat) const;
+    void update(int64_t id, const std::function<void(Chat&)>& change);
+    void set_main_order(int64_t id, const json& positions);
+
+    std::mutex mutex;
+    std::unordered_map<int64_t, Chat> chats;
+    std::set<SortKey> order;
+    bool is_loaded = false;
+
+    uint64_t epoch;        // tells apart the versions of different caches (sessions, restarts)
+    uint64_t version = 0;
+    uint64_t built_version = UINT64_MAX;
+    std::string body;
+};
@@ -1,81 +1,125 @@
 #include "common.hpp"
 #include "chats.hpp"
+#include "random.hpp"
 
 #include <iostream>
+#include <chrono>
+#include <limits>
+
+// Waits for the reply carrying `extra`, null on timeout
+static json wait_for_extra(std::shared_ptr<ClientSession> session, const std::string& extra, uint32_t& last_checked)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(TDLIB_TIMEOUT);
+
+    while(std::chrono::steady_clock::now() < deadline){
+        auto responses = session->getResponses()->get_all_for(last_checked, std::chrono::milliseconds(500));
+
+        for(const auto& [id, response] : responses){
+            last_checked = id;
+            if(!response.is_null() && response.value("@extra", "") == extra){
+                return response;
+            }
+        }
+    }
+
+    return json();
+}
 
 std::vector<json> get_chats(std::shared_ptr<ClientSession> session)
 {
-    std::vector<json> chats;
-    std::map<uint32_t, uint32_t> last_checked_map;
+    std::string prefix = "chats_" + std::to_string(rand_uint32()) + "_";
+    uint32_t last_checked = 0;
 
     session->send({
         {"@type", "getChats"},
         {"offset_order", std::to_string(std::numeric_limits<uint64_t>::max())},
         {"offset_chat_id", 0},
-        {"limit", std::numeric_limits<int>::max()}
+        {"limit", CHATS_LIMIT},
+        {"@extra", prefix + "list"}
     });
 
-    bool received = false;
-    uint32_t session_id = session->getId();
+    json list = wait_for_extra(session, prefix + "list", last_checked);
+    if(list.is_null() || list["@type"] != "chats"){
+        std::cerr << "[ERROR] getChats failed or timed out" << std::endl;
+        return {};
+    }
 
-    while(!received){
-        auto responses = session->getResponses()->get_all(last_checked_map[session_id]);
+    const json& chat_ids = list["chat_ids"];
+    std::vector<json> slots(chat_ids.size());
+
+    // getChat per chat, al massimo CHATS_FETCH_WINDOW in volo: le risposte si abbinano tramite @extra
+    // e il buffer delle risposte (limitato) non viene riempito oltre la finestra
+    size_t next = 0;
+    size_t pending = 0;
+    auto send_next = [&]() {
+        session->send({
+            {"@type", "getChat"},
+            {"chat_id", chat_ids[next]},
+            {"@extra", prefix + std::to_string(next)}
+        });
+        next++;
+        pending++;
+    };
+
+    while(next < chat_ids.size() && pending < CHATS_FETCH_WINDOW){
+        send_next();
+    }
 
-        for(auto r = responses.rbegin(); r != responses.rend(); r++){
-            json response = r->second;
-            if(response.is_null()) continue;
+    // Timeout di inattività: si arrende se per TDLIB_TIMEOUT non arriva nessuna risposta
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(TDLIB_TIMEOUT);
 
-            if(response["@type"] == "chats"){
-                const auto& chat_ids = response["chat_ids"];
+    while(pending > 0 && std::chrono::steady_clock::now() < deadline){
+        auto responses = session->getResponses()->get_all_for(last_checked, std::chrono::milliseconds(500));
 
-                if(chat_ids.empty()){
-                    return chats; // niente più chat
-                }
+        for(const auto& [id, response] : responses){
+            last_checked = id;
+            if(response.is_null()){
+                continue;
+            }
 
-                for(const auto& chat_id : chat_ids){
-                    session->send({{"@type", "getChat"}, 
-                                   {"chat_id", chat_id}});
-
-                    bool found = false;
-                    size_t null_ctr = 0;
-                    while(!found){
-                        auto chat_responses = session->getResponses()->get_all(last_checked_map[session_id]);
-                        for(auto cr = chat_responses.rbegin(); cr != chat_responses.rend(); cr++){
-                            json chat = cr->second;
-
-                            if(chat.is_null()){
-                                null_ctr++;
-                                if(null_ctr > 5){
-                                    found = true;
-                                    break;
-                                }
-                                continue;
-                            }
+            std::string extra = response.value("@extra", "");
+            if(extra.compare(0, prefix.size(), prefix) != 0 || extra == prefix + "list"){
+                continue;
+            }
 
-                            null_ctr = 0;
-
-                            if(chat["@type"] == "chat"){
-                                json chat_info = {
-                                    {"id", chat["id"]},
-                                    {"title", chat["title"]},
-                                    {"type", chat["type"]["@type"]}
-                                };
-                                chats.push_back(chat_info);
-                                found = true;
-                                break;
-                            }
-                        }
+            size_t index = std::stoul(extra.substr(prefix.size()));
+            if(index >= slots.size() || !slots[index].is_null()){
+                continue;
+            }
 
-                        last_checked_map[session_id] = chat_responses.back().first;
-                    }
-                }
+            // Anche un errore chiude la richiesta: quella chat viene saltata
+            if(response["@type"] == "chat"){
+                slots[index] = {
+                    {"id", response["id"]},
+                    {"title", response["title"]},
+                    {"type", response["type"]["@type"]}
+                };
+            }
+            else {
+                slots[index] = json::object();
+            }
+
+            pending--;
+            deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(TDLIB_TIMEOUT);
 
-                received = true;
-                break; 
+            if(next < chat_ids.size()){
+                send_next();
             }
         }
     }
 
+    if(pending > 0 || next < chat_ids.size()){
+        std::cerr << "[ERROR] getChat timed out for " << (pending + chat_ids.size() - next) << " of " << chat_ids.size() << " chats" << std::endl;
+    }
+
+    // Stesso ordine della lista restituita da getChats
+    std::vector<json> chats;
+    for(json& chat : slots){
+        if(!chat.is_null() && !chat.empty()){
+            chats.push_back(std::move(chat));
+        }
+    }
+
     return chats;
 }
 
@@ -3,5 +3,10 @@
 #include "common.hpp"
 #include "session.hpp"
 
+// getChats returns at most CHATS_LIMIT chats; the getChat calls for them are pipelined,
+// CHATS_FETCH_WINDOW at a time (responses share a bounded ring buffer)
+inline constexpr int CHATS_LIMIT = 1000;
+inline constexpr size_t CHATS_FETCH_WINDOW = 32;
+
 extern std::vector<json> get_chats(std::shared_ptr<ClientSession> session);
 extern std::vector<json> get_videos_from_channel(std::shared_ptr<ClientSession> session, const std::string &chat_id, int64_t from_message_id, int limit);
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "crc32c.hpp"
+
+#include <array>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <nmmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define CRC32C_TARGET
+    #else
+        #define CRC32C_TARGET __attribute__((target("sse4.2")))
+    #endif
+    #define CRC32C_HW_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define CRC32C_TARGET
+    #else
+        #include <arm_acle.h>
+        #define CRC32C_TARGET __attribute__((target("+crc")))
+    #endif
+    #ifdef __linux__
+        #include <sys/auxv.h>
+        #include <asm/hwcap.h>
+    #endif
+    #define CRC32C_HW_ARM
+#endif
+
+static constexpr uint32_t CRC32C_POLY = 0x82F63B78; // reflected Castagnoli polynomial
+
+static const std::array<uint32_t, 256>& software_table()
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; bit++){
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+            }
+            t[i] = crc;
+        }
+        return t;
+    }();
+    return table;
+}
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t* p, size_t length)
+{
+    const auto& table = software_table();
+    while(length--){
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(CRC32C_HW_X86)
+
+static bool hardware_supported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+CRC32C_TARGET static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint64_t crc64 = crc;
+    while(length >= 8){
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+
+    crc = static_cast<uint32_t>(crc64);
+    while(length--){
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+#elif defined(CRC32C_HW_ARM)
+
+static bool hardware_supported()
+{
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return true; // every ARM64 Windows and macOS machine has the CRC extension
+#endif
+}
+
+CRC32C_TARGET static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p, size_t length)
+{
+    while(length >= 8){
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+
+    while(length--){
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+#else
+
+static bool hardware_supported()
+{
+    return false;
+}
+
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p, size_t length)
+{
+    return crc32c_software(crc, p, length);
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length)
+{
+    static const bool hardware = hardware_supported();
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    crc = ~crc;
+    crc = hardware ? crc32c_hardware(crc, p, length) : crc32c_software(crc, p, length);
+    return ~crc;
+}
+
+bool parse_crc32c(const std::string& hex, uint32_t& crc)
+{
+    if(hex.empty() || hex.size() > 8){
+        return false;
+    }
+
+    char* end = nullptr;
+    unsigned long value = strtoul(hex.c_str(), &end, 16);
+    if(*end != '\0'){
+        return false;
+    }
+
+    crc = static_cast<uint32_t>(value);
+    return true;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// CRC-32C (Castagnoli). Uses the SSE4.2 or ARMv8 CRC instructions when the CPU has them.
+// Incremental: crc32c(crc32c(0, a), b) == crc32c(0, a + b).
+extern uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+// Parses the 8 hex digit form used by the chunk_crc32c header
+extern bool parse_crc32c(const std::string& hex, uint32_t& crc);
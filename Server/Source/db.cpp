@@ -1,118 +1,259 @@
 #include "db.hpp"
 
-#ifdef __linux__
-    #include <mysql/mysql.h>
-#else
-    #include <mysql.h>
-#endif
+#include <unordered_map>
 #include <mutex>
-#include <iostream>
+#include <array>
+#include <deque>
+#include <cctype>
+#include <iterator>
+#include <algorithm>
 
-static MYSQL* conn = nullptr;
-static std::mutex db_mutex;
-static bool db_connected = false;
-static const char* db_host = "127.0.0.1";
-static const char* db_user = "root";
-static const char* db_password = "";
-static const char* db_name = "ArchivioVideo";
+// Backend independent helpers; the backends live in db_mysql.cpp and db_sqlite.cpp
 
-int connect_db() 
+static constexpr size_t latency_bucket_count = std::size(DB_LATENCY_BUCKETS_US) + 1; // last one is +inf
+
+struct LatencyHistogram {
+    std::array<uint64_t, latency_bucket_count> buckets = {};
+    uint64_t sum_us = 0;
+    uint64_t max_us = 0;
+
+    void add(uint64_t us)
+    {
+        size_t i = 0;
+        while(i < std::size(DB_LATENCY_BUCKETS_US) && us > DB_LATENCY_BUCKETS_US[i]){
+            i++;
+        }
+        buckets[i]++;
+        sum_us += us;
+        max_us = std::max(max_us, us);
+    }
+
+    json to_json(uint64_t count) const
+    {
+        json histogram = json::object();
+        for(size_t i = 0; i < latency_bucket_count; i++){
+            std::string bound = i < std::size(DB_LATENCY_BUCKETS_US) ? std::to_string(DB_LATENCY_BUCKETS_US[i]) : "inf";
+            histogram[bound] = buckets[i];
+        }
+
+        return {
+            {"avg_us", count ? sum_us / count : 0},
+            {"max_us", max_us},
+            {"buckets_le_us", histogram}
+        };
+    }
+};
+
+struct TemplateStats {
+    uint64_t count = 0;
+    LatencyHistogram wait, execute, fetch, total;
+};
+
+struct SlowQuery {
+    std::string sql;
+    std::string params;
+    DbTiming timing;
+    int64_t at_ms;
+};
+
+static std::mutex stats_mutex;
+static std::unordered_map<std::string, TemplateStats> query_stats;
+static std::deque<SlowQuery> slow_queries; // oldest first
+
+// Literal values become `?` so queries built by concatenation share a template with their
+// prepared equivalent, and no data ends up in the metrics
+static std::string query_template(const std::string& sql)
 {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if(db_connected){
-        return 0;
+    std::string out;
+    out.reserve(sql.size());
+
+    for(size_t i = 0; i < sql.size(); i++){
+        char c = sql[i];
+
+        if(c == '\'' || c == '"'){
+            // Quotes are escaped with a backslash (MySQL) or doubled (both)
+            size_t end = i + 1;
+            while(end < sql.size() && (sql[end] != c || (end + 1 < sql.size() && sql[end + 1] == c))){
+                end += sql[end] == '\\' || sql[end] == c ? 2 : 1;
+            }
+            out += '?';
+            i = std::min(end, sql.size());
+            continue;
+        }
+
+        bool word_before = !out.empty() && (std::isalnum(static_cast<unsigned char>(out.back())) || out.back() == '_');
+        if(std::isdigit(static_cast<unsigned char>(c)) && !word_before){
+            while(i + 1 < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[i + 1])) || sql[i + 1] == '.')){
+                i++;
+            }
+            out += '?';
+            continue;
+        }
+
+        out += c;
     }
 
-    conn = mysql_init(nullptr);
-    if(conn == nullptr){
-        std::cerr << "mysql_init() failed" << std::endl;
-        return -1;
+    // IN lists of any length share one template
+    size_t pos;
+    while((pos = out.find("?, ?")) != std::string::npos || (pos = out.find("?,?")) != std::string::npos){
+        size_t comma = out.find(',', pos);
+        size_t next = out.find('?', comma);
+        out.erase(pos + 1, next - pos);
     }
 
-    if(mysql_real_connect(conn, db_host, db_user, db_password, db_name, 0, nullptr, 0) == nullptr){
-        std::cerr << "mysql_real_connect() failed: " << mysql_error(conn) << std::endl;
-        mysql_close(conn);
-        return -1;
+    while((pos = out.find("(?), (?)")) != std::string::npos){
+        out.erase(pos + 3, 5); // multi-row VALUES
     }
 
-    db_connected = true;
-    return 0;
+    return out;
 }
 
-int disconnect_db() 
+// Types and sizes only, never the values
+static std::string redact_params(const std::vector<DbValue>& params)
 {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if(conn != nullptr){
-        mysql_close(conn);
-        conn = nullptr;
-        db_connected = false;
+    std::string out;
+    for(const DbValue& value : params){
+        if(!out.empty()){
+            out += ", ";
+        }
+
+        if(const std::string* text = std::get_if<std::string>(&value)){
+            out += "string(" + std::to_string(text->size()) + ")";
+        }else if(std::holds_alternative<int64_t>(value)){
+            out += "int";
+        }else if(std::holds_alternative<double>(value)){
+            out += "double";
+        }else{
+            out += "null";
+        }
     }
-    return 0;
+    return out;
 }
 
-json db_select(const std::string& query) 
+void db_record_timing(const std::string& sql, const std::vector<DbValue>& params, const DbTiming& timing)
 {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if(!db_connected){
-        std::cerr << "Database not connected" << std::endl;
-        return json();
-    }
+    std::string key = query_template(sql);
+    uint64_t total = timing.wait_us + timing.execute_us + timing.fetch_us;
+    bool slow = total >= static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(DB_SLOW_QUERY_THRESHOLD).count());
 
-    if(mysql_query(conn, query.c_str())){
-        std::cerr << "mysql_query() failed: " << mysql_error(conn) << std::endl;
-        return json();
-    }
+    std::string redacted = slow ? redact_params(params) : "";
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
 
-    MYSQL_RES* res = mysql_store_result(conn);
-    if(res == nullptr){
-        std::cerr << "mysql_store_result() failed: " << mysql_error(conn) << std::endl;
-        return json();
+    auto it = query_stats.find(key);
+    if(it == query_stats.end()){
+        it = query_stats.size() < DB_MAX_QUERY_TEMPLATES ? query_stats.emplace(key, TemplateStats()).first
+                                                          : query_stats.emplace("other", TemplateStats()).first;
     }
 
-    int num_fields = mysql_num_fields(res);
-    MYSQL_ROW row;
-    json result = json::array();
+    TemplateStats& stats = it->second;
+    stats.count++;
+    stats.wait.add(timing.wait_us);
+    stats.execute.add(timing.execute_us);
+    stats.fetch.add(timing.fetch_us);
+    stats.total.add(total);
 
-    while((row = mysql_fetch_row(res))){
-        json obj = json::object();
-        for(int i = 0; i < num_fields; i++){
-            obj[mysql_fetch_field_direct(res, i)->name] = row[i] ? row[i] : "NULL";
+    if(slow){
+        slow_queries.push_back({ it->first, std::move(redacted), timing, now_ms });
+        if(slow_queries.size() > DB_SLOW_QUERY_LOG_SIZE){
+            slow_queries.pop_front();
         }
-        result.push_back(obj);
+    }
+}
+
+json db_query_metrics()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    json templates = json::array();
+    for(const auto& [sql, stats] : query_stats){
+        templates.push_back({
+            {"query", sql},
+            {"count", stats.count},
+            {"wait", stats.wait.to_json(stats.count)},
+            {"execute", stats.execute.to_json(stats.count)},
+            {"fetch", stats.fetch.to_json(stats.count)},
+            {"total", stats.total.to_json(stats.count)}
+        });
+    }
+
+    json slow = json::array();
+    for(auto it = slow_queries.rbegin(); it != slow_queries.rend(); ++it){
+        slow.push_back({
+            {"query", it->sql},
+            {"params", it->params},
+            {"wait_us", it->timing.wait_us},
+            {"execute_us", it->timing.execute_us},
+            {"fetch_us", it->timing.fetch_us},
+            {"at_ms", it->at_ms}
+        });
     }
 
-    mysql_free_result(res);
-    return result;
+    return {
+        {"templates", templates},
+        {"slow_threshold_ms", DB_SLOW_QUERY_THRESHOLD.count()},
+        {"slow_queries", slow}
+    };
 }
 
-int db_execute(const std::string& query) 
+int DbResult::column(const std::string& name) const
 {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if(!db_connected){
-        std::cerr << "Database not connected" << std::endl;
-        return -1;
+    for(size_t i = 0; i < columns.size(); i++){
+        if(columns[i] == name){
+            return static_cast<int>(i);
+        }
     }
+    return -1;
+}
 
-    if(mysql_query(conn, query.c_str())){
-        std::cerr << "mysql_query() failed: " << mysql_error(conn) << std::endl;
-        return -1;
+json DbResult::to_json() const
+{
+    json out = json::array();
+
+    for(const DbRow& row : rows){
+        json obj = json::object();
+        for(size_t i = 0; i < columns.size(); i++){
+            obj[columns[i]] = db_value_to_json(row[i]);
+        }
+        out.push_back(std::move(obj));
     }
 
-    return 0;
+    return out;
 }
 
-std::string escape_string(const std::string& str) 
+int64_t db_int(const DbValue& value, int64_t fallback)
 {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if(!db_connected){
-        std::cerr << "Database not connected" << std::endl;
-        return str;
+    if(const int64_t* integer = std::get_if<int64_t>(&value)){
+        return *integer;
+    }
+    if(const double* real = std::get_if<double>(&value)){
+        return static_cast<int64_t>(*real);
+    }
+    if(const std::string* text = std::get_if<std::string>(&value)){
+        try{
+            return std::stoll(*text);
+        }catch(const std::exception&){
+        }
     }
+    return fallback;
+}
 
-    char* escaped_str = new char[str.length() * 2 + 1];
-    mysql_real_escape_string(conn, escaped_str, str.c_str(), str.length());
-    std::string result(escaped_str);
-    delete[] escaped_str;
+std::string db_string(const DbValue& value)
+{
+    if(const std::string* text = std::get_if<std::string>(&value)){
+        return *text;
+    }
+    if(const int64_t* integer = std::get_if<int64_t>(&value)){
+        return std::to_string(*integer);
+    }
+    if(const double* real = std::get_if<double>(&value)){
+        return std::to_string(*real);
+    }
+    return "";
+}
 
-    return result;
-}
\ No newline at end of file
+json db_value_to_json(const DbValue& value)
+{
+    return std::visit([](const auto& v) -> json { return v; }, value);
+}
@@ -3,11 +3,108 @@
 #include <nlohmann/json.hpp>
 #include <string>
 #include <vector>
+#include <variant>
+#include <chrono>
+#include <functional>
+#include <cstdint>
 
 using json = nlohmann::json;
 
-extern int connect_db();
+// Metadata lives in MySQL (db_mysql.cpp) or, when built with DB_SQLITE (premake --sqlite), in an
+// embedded SQLite file (db_sqlite.cpp). Both implement the functions below; SQL that differs
+// between them goes through the db_on_conflict_* / db_today helpers.
+
+// Queries run on a pool of connections; a handler waits at most DB_CHECKOUT_TIMEOUT for a free one
+inline constexpr unsigned int DB_POOL_SIZE = 8;
+inline constexpr auto DB_CHECKOUT_TIMEOUT = std::chrono::seconds(5);
+inline constexpr auto DB_PING_INTERVAL = std::chrono::seconds(30);
+
+// Prepared statements are cached per connection, keyed by their SQL text
+inline constexpr size_t DB_STATEMENT_CACHE_SIZE = 64;
+
+// SQLite: one writer connection plus DB_POOL_SIZE read-only connections on the WAL file
+inline constexpr const char* DB_SQLITE_PATH = "UserData/archivio.db";
+inline constexpr int DB_SQLITE_BUSY_TIMEOUT_MS = 5000;
+
+// Query instrumentation: histogram bucket bounds (upper, in microseconds) and the slow-query log
+inline constexpr uint64_t DB_LATENCY_BUCKETS_US[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000 };
+inline constexpr size_t DB_MAX_QUERY_TEMPLATES = 256; // later templates are counted under "other"
+inline constexpr auto DB_SLOW_QUERY_THRESHOLD = std::chrono::milliseconds(100);
+inline constexpr size_t DB_SLOW_QUERY_LOG_SIZE = 64;
+
+// Typed column or parameter value of a prepared statement
+using DbValue = std::variant<std::nullptr_t, int64_t, double, std::string>;
+using DbRow = std::vector<DbValue>;
+
+struct DbResult {
+    bool ok = false;
+    std::vector<std::string> columns;
+    std::vector<DbRow> rows;
+    uint64_t affected_rows = 0;
+    uint64_t insert_id = 0; // also the first returned column of an INSERT ... RETURNING
+
+    int column(const std::string& name) const;
+    json to_json() const;
+};
+
+struct DbConnection;
+
+// Statements of one transaction, all on the same pooled connection
+class DbTransaction{
+public:
+    explicit DbTransaction(DbConnection& connection) : connection(connection) {}
+
+    DbResult query(const std::string& sql, const std::vector<DbValue>& params = {});
+
+    // Backend error code of the last failed query, 0 if none failed
+    unsigned int error() const { return last_error; }
+
+private:
+    DbConnection& connection;
+    unsigned int last_error = 0;
+};
+
+extern int connect_db(unsigned int pool_size = DB_POOL_SIZE);
 extern int disconnect_db();
 extern json db_select(const std::string& query);
 extern int db_execute(const std::string& query);
 extern std::string escape_string(const std::string& str);
+extern json db_pool_metrics();
+extern const char* db_backend_name();
+
+// Runs `sql` with `?` placeholders bound to `params`, using the binary protocol
+extern DbResult db_query(const std::string& sql, const std::vector<DbValue>& params = {});
+
+// Runs `body` inside BEGIN/COMMIT; it is rolled back if `body` returns false or a query fails.
+// A transaction that lost its connection or hit a deadlock is run again once from the start,
+// so `body` must not keep state between calls.
+extern bool db_transaction(const std::function<bool(DbTransaction&)>& body);
+
+// Streams the rows of `sql` without buffering the result: each row is read from the server and
+// handed to `on_row` (same `columns` vector for every row), which returns false to stop early.
+// The pooled connection stays checked out until the last row: a slow consumer holds it that long.
+using DbRowCallback = std::function<bool(const std::vector<std::string>& columns, const DbRow& row)>;
+extern bool db_stream(const std::string& sql, const std::vector<DbValue>& params, const DbRowCallback& on_row);
+
+// Dialect helpers. `key_columns` is the unique key an INSERT may collide with, e.g. "chat_id, message_id".
+// db_on_conflict_id keeps the existing row and reports its id as insert_id.
+extern std::string db_on_conflict_ignore(const std::string& key_columns);
+extern std::string db_on_conflict_update(const std::string& key_columns, const std::vector<std::string>& update_columns);
+extern std::string db_on_conflict_id(const std::string& key_columns, const std::string& id_column);
+extern std::string db_today();
+extern bool db_index_exists(const std::string& table, const std::string& index);
+
+// Time spent by one statement: waiting for a connection (pool or SQLite writer lock), executing
+// it and fetching/converting the rows. Recorded by the backends, exported by db_query_metrics().
+struct DbTiming {
+    uint64_t wait_us = 0;
+    uint64_t execute_us = 0;
+    uint64_t fetch_us = 0;
+};
+
+extern void db_record_timing(const std::string& sql, const std::vector<DbValue>& params, const DbTiming& timing);
+extern json db_query_metrics();
+
+extern int64_t db_int(const DbValue& value, int64_t fallback = 0);
+extern std::string db_string(const DbValue& value);
+extern json db_value_to_json(const DbValue& value);
@@ -0,0 +1,787 @@
+#include "db.hpp"
+
+#ifndef DB_SQLITE
+
+#ifdef __linux__
+    #include <mysql/mysql.h>
+    #include <mysql/errmsg.h>
+    #include <mysql/mysqld_error.h>
+#else
+    #include <mysql.h>
+    #include <errmsg.h>
+    #include <mysqld_error.h>
+#endif
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <type_traits>
+#include <functional>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <iostream>
+
+struct DbConnection {
+    MYSQL* conn = nullptr;
+    std::chrono::steady_clock::time_point last_used;
+    std::unordered_map<std::string, MYSQL_STMT*> statements;
+};
+
+// my_bool in older client libraries, bool since MySQL 8
+using db_bool = std::remove_pointer_t<decltype(MYSQL_BIND::is_null)>;
+
+static std::vector<std::unique_ptr<DbConnection>> db_connections;
+static std::deque<DbConnection*> db_idle;
+static std::mutex db_mutex; // guards the pool, not the connections
+static std::condition_variable db_cv;
+static bool db_connected = false;
+
+// Only used by escape_string: it reads the connection charset and never runs queries,
+// so it needs no lock
+static MYSQL* escape_conn = nullptr;
+
+static const char* db_host = "127.0.0.1";
+static const char* db_user = "root";
+static const char* db_password = "";
+static const char* db_name = "ArchivioVideo";
+
+static std::atomic<uint64_t> checkouts = 0;
+static std::atomic<uint64_t> checkout_waits = 0;
+static std::atomic<uint64_t> checkout_timeouts = 0;
+static std::atomic<uint64_t> checkout_wait_us = 0;
+static std::atomic<uint64_t> checkout_wait_max_us = 0;
+static std::atomic<uint64_t> reconnects = 0;
+
+static MYSQL* open_connection()
+{
+    MYSQL* conn = mysql_init(nullptr);
+    if(conn == nullptr){
+        std::cerr << "mysql_init() failed" << std::endl;
+        return nullptr;
+    }
+
+    if(mysql_real_connect(conn, db_host, db_user, db_password, db_name, 0, nullptr, 0) == nullptr){
+        std::cerr << "mysql_real_connect() failed: " << mysql_error(conn) << std::endl;
+        mysql_close(conn);
+        return nullptr;
+    }
+
+    return conn;
+}
+
+static void close_statements(DbConnection& connection)
+{
+    for(auto& [sql, stmt] : connection.statements){
+        mysql_stmt_close(stmt);
+    }
+    connection.statements.clear();
+}
+
+static bool reconnect(DbConnection& connection)
+{
+    close_statements(connection);
+
+    if(connection.conn){
+        mysql_close(connection.conn);
+    }
+
+    reconnects++;
+    connection.conn = open_connection();
+    return connection.conn != nullptr;
+}
+
+// Connections idle for a while may have been dropped by the server (wait_timeout)
+static bool ensure_alive(DbConnection& connection)
+{
+    if(connection.conn && std::chrono::steady_clock::now() - connection.last_used < DB_PING_INTERVAL){
+        return true;
+    }
+
+    if(connection.conn && mysql_ping(connection.conn) == 0){
+        return true;
+    }
+
+    std::cerr << "[ERROR] Database connection lost, reconnecting" << std::endl;
+    return reconnect(connection);
+}
+
+static void record_wait(uint64_t wait_us)
+{
+    checkout_wait_us += wait_us;
+
+    uint64_t max = checkout_wait_max_us;
+    while(wait_us > max && !checkout_wait_max_us.compare_exchange_weak(max, wait_us)){}
+}
+
+static DbConnection* checkout()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(db_mutex);
+
+    if(!db_connected){
+        std::cerr << "Database not connected" << std::endl;
+        return nullptr;
+    }
+
+    checkouts++;
+
+    if(db_idle.empty()){
+        checkout_waits++;
+        if(!db_cv.wait_for(lock, DB_CHECKOUT_TIMEOUT, [] { return !db_connected || !db_idle.empty(); }) || !db_connected){
+            checkout_timeouts++;
+            std::cerr << "[ERROR] Timed out waiting for a database connection" << std::endl;
+            return nullptr;
+        }
+    }
+
+    DbConnection* connection = db_idle.front();
+    db_idle.pop_front();
+    lock.unlock();
+
+    record_wait(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if(!ensure_alive(*connection)){
+        std::lock_guard<std::mutex> relock(db_mutex);
+        db_idle.push_back(connection);
+        db_cv.notify_one();
+        return nullptr;
+    }
+
+    return connection;
+}
+
+static void checkin(DbConnection* connection)
+{
+    connection->last_used = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(db_mutex);
+    db_idle.push_back(connection);
+    db_cv.notify_one();
+}
+
+// Returns the connection to the pool when it goes out of scope
+class ConnectionLease{
+public:
+    ConnectionLease() : connection(checkout()) {}
+    ~ConnectionLease() { if(connection) checkin(connection); }
+
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease& operator=(const ConnectionLease&) = delete;
+
+    explicit operator bool() const { return connection != nullptr; }
+    DbConnection& operator*() const { return *connection; }
+
+private:
+    DbConnection* connection;
+};
+
+static uint64_t elapsed_us(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static bool connection_lost(MYSQL* conn)
+{
+    unsigned int error = mysql_errno(conn);
+    return error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST;
+}
+
+// Runs the query, reconnecting and retrying once if the server dropped the connection
+static bool run_query(DbConnection& connection, const std::string& query)
+{
+    if(mysql_real_query(connection.conn, query.c_str(), query.size()) == 0){
+        return true;
+    }
+
+    if(connection_lost(connection.conn) && reconnect(connection) && mysql_real_query(connection.conn, query.c_str(), query.size()) == 0){
+        return true;
+    }
+
+    std::cerr << "mysql_query() failed: " << (connection.conn ? mysql_error(connection.conn) : "no connection") << std::endl;
+    return false;
+}
+
+int connect_db(unsigned int pool_size)
+{
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if(db_connected){
+        return 0;
+    }
+
+    // Not thread safe: must run before the connections are used from several threads
+    mysql_library_init(0, nullptr, nullptr);
+
+    escape_conn = open_connection();
+    if(escape_conn == nullptr){
+        return -1;
+    }
+
+    for(unsigned int i = 0; i < std::max(1u, pool_size); i++){
+        auto connection = std::make_unique<DbConnection>();
+        connection->conn = open_connection();
+        if(connection->conn == nullptr){
+            break;
+        }
+
+        connection->last_used = std::chrono::steady_clock::now();
+        db_idle.push_back(connection.get());
+        db_connections.push_back(std::move(connection));
+    }
+
+    if(db_connections.empty()){
+        mysql_close(escape_conn);
+        escape_conn = nullptr;
+        return -1;
+    }
+
+    std::cout << "Database pool ready with " << db_connections.size() << " connections" << std::endl;
+    db_connected = true;
+    return 0;
+}
+
+int disconnect_db()
+{
+    std::unique_lock<std::mutex> lock(db_mutex);
+    if(!db_connected){
+        return 0;
+    }
+
+    // Wait for the queries in flight, then close everything
+    db_connected = false;
+    db_cv.notify_all();
+    db_cv.wait_for(lock, DB_CHECKOUT_TIMEOUT, [] { return db_idle.size() == db_connections.size(); });
+
+    for(auto& connection : db_connections){
+        close_statements(*connection);
+        if(connection->conn){
+            mysql_close(connection->conn);
+        }
+    }
+
+    db_connections.clear();
+    db_idle.clear();
+
+    mysql_close(escape_conn);
+    escape_conn = nullptr;
+    return 0;
+}
+
+json db_select(const std::string& query)
+{
+    DbTiming timing;
+    auto start = std::chrono::steady_clock::now();
+
+    ConnectionLease connection;
+    if(!connection){
+        return json();
+    }
+    timing.wait_us = elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    if(!run_query(*connection, query)){
+        return json();
+    }
+    timing.execute_us = elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    MYSQL* conn = (*connection).conn;
+    MYSQL_RES* res = mysql_store_result(conn);
+    if(res == nullptr){
+        std::cerr << "mysql_store_result() failed: " << mysql_error(conn) << std::endl;
+        return json();
+    }
+
+    int num_fields = mysql_num_fields(res);
+    MYSQL_FIELD* fields = mysql_fetch_fields(res);
+    std::vector<std::string> names;
+    for(int i = 0; i < num_fields; i++){
+        names.push_back(fields[i].name);
+    }
+
+    MYSQL_ROW row;
+    json result = json::array();
+
+    while((row = mysql_fetch_row(res))){
+        json obj = json::object();
+        for(int i = 0; i < num_fields; i++){
+            obj[names[i]] = row[i] ? row[i] : "NULL";
+        }
+        result.push_back(obj);
+    }
+
+    mysql_free_result(res);
+
+    timing.fetch_us = elapsed_us(start);
+    db_record_timing(query, {}, timing);
+    return result;
+}
+
+int db_execute(const std::string& query)
+{
+    DbTiming timing;
+    auto start = std::chrono::steady_clock::now();
+
+    ConnectionLease connection;
+    if(!connection){
+        return -1;
+    }
+    timing.wait_us = elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    if(!run_query(*connection, query)){
+        return -1;
+    }
+    timing.execute_us = elapsed_us(start);
+
+    db_record_timing(query, {}, timing);
+    return 0;
+}
+
+std::string escape_string(const std::string& str)
+{
+    if(escape_conn == nullptr){
+        std::cerr << "Database not connected" << std::endl;
+        return str;
+    }
+
+    std::string escaped(str.length() * 2 + 1, '\0');
+    unsigned long length = mysql_real_escape_string(escape_conn, escaped.data(), str.c_str(), str.length());
+    escaped.resize(length);
+
+    return escaped;
+}
+
+json db_pool_metrics()
+{
+    size_t size, idle;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        size = db_connections.size();
+        idle = db_idle.size();
+    }
+
+    uint64_t total = checkouts;
+    return {
+        {"size", size},
+        {"idle", idle},
+        {"checkouts", total},
+        {"checkout_waits", checkout_waits.load()},
+        {"checkout_timeouts", checkout_timeouts.load()},
+        {"checkout_wait_avg_us", total ? checkout_wait_us.load() / total : 0},
+        {"checkout_wait_max_us", checkout_wait_max_us.load()},
+        {"reconnects", reconnects.load()}
+    };
+}
+
+// Returns the cached statement for `sql`, preparing it on first use
+static MYSQL_STMT* prepare_statement(DbConnection& connection, const std::string& sql, unsigned int& error)
+{
+    auto it = connection.statements.find(sql);
+    if(it != connection.statements.end()){
+        return it->second;
+    }
+
+    if(connection.statements.size() >= DB_STATEMENT_CACHE_SIZE){
+        close_statements(connection);
+    }
+
+    MYSQL_STMT* stmt = mysql_stmt_init(connection.conn);
+    if(stmt == nullptr){
+        error = mysql_errno(connection.conn);
+        return nullptr;
+    }
+
+    if(mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0){
+        error = mysql_stmt_errno(stmt);
+        std::cerr << "mysql_stmt_prepare() failed: " << mysql_stmt_error(stmt) << " in " << sql << std::endl;
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    connection.statements[sql] = stmt;
+    return stmt;
+}
+
+enum class ColumnKind {
+    Integer,
+    Real,
+    Text
+};
+
+static ColumnKind column_kind(const MYSQL_FIELD& field)
+{
+    switch(field.type){
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_YEAR:
+            return ColumnKind::Integer;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            return ColumnKind::Real;
+        default:
+            return ColumnKind::Text; // strings, blobs, decimals and dates (as "YYYY-MM-DD")
+    }
+}
+
+// Output buffers of one result column
+struct ColumnBuffer {
+    ColumnKind kind = ColumnKind::Text;
+    long long integer = 0;
+    double real = 0;
+    std::vector<char> text;
+    unsigned long length = 0;
+    db_bool is_null = 0;
+    db_bool error = 0;
+};
+
+static void bind_params(const std::vector<DbValue>& params, std::vector<MYSQL_BIND>& binds, std::vector<unsigned long>& lengths)
+{
+    binds.assign(params.size(), MYSQL_BIND());
+    lengths.assign(params.size(), 0);
+
+    for(size_t i = 0; i < params.size(); i++){
+        MYSQL_BIND& bind = binds[i];
+        memset(&bind, 0, sizeof(bind));
+
+        if(const int64_t* integer = std::get_if<int64_t>(&params[i])){
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = const_cast<int64_t*>(integer);
+        }else if(const double* real = std::get_if<double>(&params[i])){
+            bind.buffer_type = MYSQL_TYPE_DOUBLE;
+            bind.buffer = const_cast<double*>(real);
+        }else if(const std::string* text = std::get_if<std::string>(&params[i])){
+            lengths[i] = text->size();
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = const_cast<char*>(text->data());
+            bind.buffer_length = text->size();
+            bind.length = &lengths[i];
+        }else{
+            bind.buffer_type = MYSQL_TYPE_NULL;
+        }
+    }
+}
+
+// Fetches the rows of an executed statement, buffered (after mysql_stmt_store_result) or straight
+// from the server. Column names are resolved once into `names`; `on_row` returns false to stop.
+static bool fetch_rows(MYSQL_STMT* stmt, MYSQL_RES* meta, std::vector<std::string>& names, const std::function<bool(DbRow&)>& on_row)
+{
+    unsigned int count = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+
+    std::vector<ColumnBuffer> columns(count);
+    std::vector<MYSQL_BIND> binds(count);
+
+    for(unsigned int i = 0; i < count; i++){
+        ColumnBuffer& column = columns[i];
+        MYSQL_BIND& bind = binds[i];
+        memset(&bind, 0, sizeof(bind));
+
+        names.push_back(fields[i].name);
+        column.kind = column_kind(fields[i]);
+
+        if(column.kind == ColumnKind::Integer){
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = &column.integer;
+            bind.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+        }else if(column.kind == ColumnKind::Real){
+            bind.buffer_type = MYSQL_TYPE_DOUBLE;
+            bind.buffer = &column.real;
+        }else{
+            column.text.resize(256);
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = column.text.data();
+            bind.buffer_length = column.text.size();
+        }
+
+        bind.length = &column.length;
+        bind.is_null = &column.is_null;
+        bind.error = &column.error;
+    }
+
+    if(mysql_stmt_bind_result(stmt, binds.data()) != 0){
+        std::cerr << "mysql_stmt_bind_result() failed: " << mysql_stmt_error(stmt) << std::endl;
+        return false;
+    }
+
+    while(true){
+        int status = mysql_stmt_fetch(stmt);
+        if(status == MYSQL_NO_DATA){
+            break;
+        }
+        if(status == 1){
+            std::cerr << "mysql_stmt_fetch() failed: " << mysql_stmt_error(stmt) << std::endl;
+            return false;
+        }
+
+        DbRow row(count);
+        for(unsigned int i = 0; i < count; i++){
+            ColumnBuffer& column = columns[i];
+
+            if(column.is_null){
+                row[i] = nullptr;
+            }else if(column.kind == ColumnKind::Integer){
+                row[i] = static_cast<int64_t>(column.integer);
+            }else if(column.kind == ColumnKind::Real){
+                row[i] = column.real;
+            }else if(column.length <= column.text.size()){
+                row[i] = std::string(column.text.data(), column.length);
+            }else{
+                // Longer than the bound buffer (MYSQL_DATA_TRUNCATED): fetch this column again in full
+                std::string text(column.length, '\0');
+                MYSQL_BIND full = binds[i];
+                full.buffer = text.data();
+                full.buffer_length = text.size();
+                mysql_stmt_fetch_column(stmt, &full, i, 0);
+                row[i] = std::move(text);
+            }
+        }
+
+        if(!on_row(row)){
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Prepares, binds and executes `sql`. Returns the statement or nullptr with `error` set
+static MYSQL_STMT* execute_statement(DbConnection& connection, const std::string& sql, const std::vector<DbValue>& params, unsigned int& error)
+{
+    error = 0;
+    MYSQL_STMT* stmt = prepare_statement(connection, sql, error);
+    if(stmt == nullptr){
+        error = error ? error : CR_UNKNOWN_ERROR;
+        return nullptr;
+    }
+
+    if(mysql_stmt_param_count(stmt) != params.size()){
+        std::cerr << "[ERROR] " << sql << " expects " << mysql_stmt_param_count(stmt) << " parameters, got " << params.size() << std::endl;
+        error = CR_UNKNOWN_ERROR;
+        return nullptr;
+    }
+
+    std::vector<MYSQL_BIND> binds;
+    std::vector<unsigned long> lengths;
+    bind_params(params, binds, lengths);
+
+    if((!binds.empty() && mysql_stmt_bind_param(stmt, binds.data()) != 0) || mysql_stmt_execute(stmt) != 0){
+        error = mysql_stmt_errno(stmt);
+        std::cerr << "mysql_stmt_execute() failed: " << mysql_stmt_error(stmt) << std::endl;
+        return nullptr;
+    }
+
+    return stmt;
+}
+
+// Returns 0 on success or the MySQL error code
+static unsigned int run_statement(DbConnection& connection, const std::string& sql, const std::vector<DbValue>& params, DbResult& result,
+                                  DbTiming& timing)
+{
+    auto start = std::chrono::steady_clock::now();
+    unsigned int error = 0;
+    MYSQL_STMT* stmt = execute_statement(connection, sql, params, error);
+    timing.execute_us += elapsed_us(start);
+    if(stmt == nullptr){
+        return error;
+    }
+
+    start = std::chrono::steady_clock::now();
+
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+    if(meta == nullptr){
+        result.affected_rows = mysql_stmt_affected_rows(stmt);
+        result.insert_id = mysql_stmt_insert_id(stmt);
+        result.ok = true;
+        return 0;
+    }
+
+    // Buffer the whole result so the connection goes back to the pool right away
+    bool ok = mysql_stmt_store_result(stmt) == 0 && fetch_rows(stmt, meta, result.columns, [&](DbRow& row){
+        result.rows.push_back(std::move(row));
+        return true;
+    });
+    error = ok ? 0 : (mysql_stmt_errno(stmt) ? mysql_stmt_errno(stmt) : CR_UNKNOWN_ERROR);
+
+    mysql_free_result(meta);
+    mysql_stmt_free_result(stmt);
+    timing.fetch_us += elapsed_us(start);
+
+    result.ok = ok;
+    return error;
+}
+
+DbResult db_query(const std::string& sql, const std::vector<DbValue>& params)
+{
+    DbTiming timing;
+    auto start = std::chrono::steady_clock::now();
+
+    ConnectionLease connection;
+    if(!connection){
+        return DbResult();
+    }
+    timing.wait_us = elapsed_us(start);
+
+    DbResult result;
+    unsigned int error = run_statement(*connection, sql, params, result, timing);
+
+    if(error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST){
+        result = DbResult();
+        if(reconnect(*connection)){
+            run_statement(*connection, sql, params, result, timing);
+        }
+    }
+
+    db_record_timing(sql, params, timing);
+    return result;
+}
+
+DbResult DbTransaction::query(const std::string& sql, const std::vector<DbValue>& params)
+{
+    DbResult result;
+    if(last_error != 0){
+        return result; // the transaction already failed, it will be rolled back
+    }
+
+    // The connection is already held: no wait time
+    DbTiming timing;
+    last_error = run_statement(connection, sql, params, result, timing);
+    db_record_timing(sql, params, timing);
+    return result;
+}
+
+static bool retry_transaction(unsigned int error)
+{
+    return error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST || error == ER_LOCK_DEADLOCK;
+}
+
+bool db_transaction(const std::function<bool(DbTransaction&)>& body)
+{
+    ConnectionLease connection;
+    if(!connection){
+        return false;
+    }
+
+    for(int attempt = 0; attempt < 2; attempt++){
+        if(!run_query(*connection, "START TRANSACTION")){
+            return false;
+        }
+
+        DbTransaction transaction(*connection);
+        bool ok = body(transaction) && transaction.error() == 0;
+
+        if(ok && mysql_commit((*connection).conn) == 0){
+            return true;
+        }
+
+        unsigned int error = transaction.error() ? transaction.error() : mysql_errno((*connection).conn);
+        mysql_rollback((*connection).conn);
+
+        if(!retry_transaction(error)){
+            return false;
+        }
+
+        if(connection_lost((*connection).conn) && !reconnect(*connection)){
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool db_stream(const std::string& sql, const std::vector<DbValue>& params, const DbRowCallback& on_row)
+{
+    DbTiming timing;
+    auto start = std::chrono::steady_clock::now();
+
+    ConnectionLease connection;
+    if(!connection){
+        return false;
+    }
+    timing.wait_us = elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    unsigned int error = 0;
+    MYSQL_STMT* stmt = execute_statement(*connection, sql, params, error);
+    if(stmt == nullptr && (error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST) && reconnect(*connection)){
+        stmt = execute_statement(*connection, sql, params, error);
+    }
+    timing.execute_us = elapsed_us(start);
+    if(stmt == nullptr){
+        return false;
+    }
+
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+    if(meta == nullptr){
+        return true; // not a SELECT, no rows
+    }
+
+    // No mysql_stmt_store_result: each fetch reads the next row from the server.
+    // The fetch time therefore includes the consumer (e.g. a slow HTTP client)
+    start = std::chrono::steady_clock::now();
+    std::vector<std::string> columns;
+    bool stopped = false;
+    bool ok = fetch_rows(stmt, meta, columns, [&](DbRow& row){
+        stopped = !on_row(columns, row);
+        return !stopped;
+    });
+
+    if(!ok && connection_lost((*connection).conn)){
+        reconnect(*connection); // statements of a dropped connection cannot be reused
+    }else{
+        mysql_stmt_free_result(stmt); // also discards the rows left unread after a stop
+    }
+
+    mysql_free_result(meta);
+
+    timing.fetch_us = elapsed_us(start);
+    db_record_timing(sql, params, timing);
+    return ok;
+}
+
+const char* db_backend_name()
+{
+    return "mysql";
+}
+
+std::string db_on_conflict_ignore(const std::string& key_columns)
+{
+    // A no-op update rather than INSERT IGNORE, which would also hide other errors
+    std::string column = key_columns.substr(0, key_columns.find(','));
+    return "ON DUPLICATE KEY UPDATE " + column + " = " + column;
+}
+
+std::string db_on_conflict_update(const std::string& key_columns, const std::vector<std::string>& update_columns)
+{
+    if(update_columns.empty()){
+        return db_on_conflict_ignore(key_columns);
+    }
+
+    std::string sql = "ON DUPLICATE KEY UPDATE ";
+    for(size_t i = 0; i < update_columns.size(); i++){
+        sql += (i ? ", " : "") + update_columns[i] + " = VALUES(" + update_columns[i] + ")";
+    }
+    return sql;
+}
+
+std::string db_on_conflict_id(const std::string&, const std::string& id_column)
+{
+    return "ON DUPLICATE KEY UPDATE " + id_column + " = LAST_INSERT_ID(" + id_column + ")";
+}
+
+std::string db_today()
+{
+    return "CURDATE()";
+}
+
+bool db_index_exists(const std::string& table, const std::string& index)
+{
+    DbResult result = db_query("SELECT 1 FROM information_schema.statistics WHERE table_schema = DATABASE() "
+                               "AND table_name = ? AND index_name = ? LIMIT 1;", { table, index });
+    return result.ok && !result.rows.empty();
+}
+
+#endif
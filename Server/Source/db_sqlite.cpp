@@ -0,0 +1,616 @@
+#include "db.hpp"
+
+#ifdef DB_SQLITE
+
+#include <sqlite3.h>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <filesystem>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <cctype>
+#include <algorithm>
+#include <iostream>
+
+struct DbConnection {
+    sqlite3* conn = nullptr;
+    std::unordered_map<std::string, sqlite3_stmt*> statements;
+};
+
+// SQLite allows a single writer at a time: every write and transaction goes through `writer`,
+// reads use a pool of read-only connections that WAL lets run next to it
+static std::unique_ptr<DbConnection> writer;
+static std::mutex writer_mutex;
+
+static std::vector<std::unique_ptr<DbConnection>> readers;
+static std::deque<DbConnection*> idle_readers;
+static std::mutex db_mutex; // guards the reader pool, not the connections
+static std::condition_variable db_cv;
+static bool db_connected = false;
+
+static std::atomic<uint64_t> checkouts = 0;
+static std::atomic<uint64_t> checkout_waits = 0;
+static std::atomic<uint64_t> checkout_timeouts = 0;
+static std::atomic<uint64_t> checkout_wait_us = 0;
+static std::atomic<uint64_t> checkout_wait_max_us = 0;
+
+// Same tables as Database.sql; the indexes are added by the migrations
+static const char* base_schema =
+    "CREATE TABLE IF NOT EXISTS telegram_video(id INTEGER PRIMARY KEY AUTOINCREMENT, message_id INTEGER, chat_id INTEGER);"
+    "CREATE TABLE IF NOT EXISTS image(id INTEGER PRIMARY KEY AUTOINCREMENT, original_filename TEXT, saved_filename TEXT);"
+    "CREATE TABLE IF NOT EXISTS video(id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT, description TEXT, data_caricamento TEXT, "
+    "telegram_video_id INTEGER REFERENCES telegram_video(id), thumbnail_id INTEGER REFERENCES image(id));"
+    "CREATE TABLE IF NOT EXISTS content_hash(hash TEXT PRIMARY KEY, remote_file_id TEXT, size INTEGER);";
+
+static bool exec(sqlite3* conn, const char* sql)
+{
+    char* error = nullptr;
+    if(sqlite3_exec(conn, sql, nullptr, nullptr, &error) != SQLITE_OK){
+        std::cerr << "sqlite3_exec() failed: " << (error ? error : sqlite3_errmsg(conn)) << std::endl;
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+static sqlite3* open_connection(bool read_only)
+{
+    sqlite3* conn = nullptr;
+    int flags = (read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) | SQLITE_OPEN_NOMUTEX;
+
+    if(sqlite3_open_v2(DB_SQLITE_PATH, &conn, flags, nullptr) != SQLITE_OK){
+        std::cerr << "sqlite3_open_v2() failed: " << (conn ? sqlite3_errmsg(conn) : "out of memory") << std::endl;
+        sqlite3_close(conn);
+        return nullptr;
+    }
+
+    sqlite3_busy_timeout(conn, DB_SQLITE_BUSY_TIMEOUT_MS);
+
+    // WAL is a property of the file, set once by the writer before the readers open it
+    const char* setup = read_only ? "PRAGMA foreign_keys = ON;"
+                                  : "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL; PRAGMA foreign_keys = ON;";
+    if(!exec(conn, setup)){
+        sqlite3_close(conn);
+        return nullptr;
+    }
+
+    return conn;
+}
+
+static void close_connection(DbConnection& connection)
+{
+    for(auto& [sql, stmt] : connection.statements){
+        sqlite3_finalize(stmt);
+    }
+    connection.statements.clear();
+
+    sqlite3_close(connection.conn);
+    connection.conn = nullptr;
+}
+
+static uint64_t elapsed_us(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static void record_wait(uint64_t wait_us)
+{
+    checkout_wait_us += wait_us;
+
+    uint64_t max = checkout_wait_max_us;
+    while(wait_us > max && !checkout_wait_max_us.compare_exchange_weak(max, wait_us)){}
+}
+
+static DbConnection* checkout_reader()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(db_mutex);
+
+    if(!db_connected){
+        std::cerr << "Database not connected" << std::endl;
+        return nullptr;
+    }
+
+    checkouts++;
+
+    if(idle_readers.empty()){
+        checkout_waits++;
+        if(!db_cv.wait_for(lock, DB_CHECKOUT_TIMEOUT, [] { return !db_connected || !idle_readers.empty(); }) || !db_connected){
+            checkout_timeouts++;
+            std::cerr << "[ERROR] Timed out waiting for a database connection" << std::endl;
+            return nullptr;
+        }
+    }
+
+    DbConnection* connection = idle_readers.front();
+    idle_readers.pop_front();
+    lock.unlock();
+
+    record_wait(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    return connection;
+}
+
+static void checkin_reader(DbConnection* connection)
+{
+    std::lock_guard<std::mutex> lock(db_mutex);
+    idle_readers.push_back(connection);
+    db_cv.notify_one();
+}
+
+// A read connection from the pool, or the writer (held exclusively) for anything else
+class ConnectionLease{
+public:
+    explicit ConnectionLease(bool read_only)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if(read_only){
+            connection = checkout_reader();
+        }else{
+            writer_lock = std::unique_lock<std::mutex>(writer_mutex);
+            connection = db_connected ? writer.get() : nullptr;
+        }
+
+        waited_us = elapsed_us(start);
+    }
+
+    ~ConnectionLease()
+    {
+        if(connection && !writer_lock.owns_lock()){
+            checkin_reader(connection);
+        }
+    }
+
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease& operator=(const ConnectionLease&) = delete;
+
+    explicit operator bool() const { return connection != nullptr; }
+    DbConnection& operator*() const { return *connection; }
+
+    // Time spent waiting for a reader or for the writer lock
+    uint64_t wait_us() const { return waited_us; }
+
+private:
+    DbConnection* connection = nullptr;
+    std::unique_lock<std::mutex> writer_lock;
+    uint64_t waited_us = 0;
+};
+
+static bool starts_with_keyword(const std::string& sql, const char* keyword)
+{
+    size_t i = 0;
+    while(i < sql.size() && std::isspace(static_cast<unsigned char>(sql[i]))){
+        i++;
+    }
+
+    for(size_t k = 0; keyword[k]; k++, i++){
+        if(i >= sql.size() || std::toupper(static_cast<unsigned char>(sql[i])) != keyword[k]){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_read(const std::string& sql)
+{
+    return starts_with_keyword(sql, "SELECT") || starts_with_keyword(sql, "WITH");
+}
+
+// Returns the cached statement for `sql`, preparing it on first use
+static sqlite3_stmt* prepare_statement(DbConnection& connection, const std::string& sql, int& error)
+{
+    auto it = connection.statements.find(sql);
+    if(it != connection.statements.end()){
+        return it->second;
+    }
+
+    if(connection.statements.size() >= DB_STATEMENT_CACHE_SIZE){
+        for(auto& [cached_sql, stmt] : connection.statements){
+            sqlite3_finalize(stmt);
+        }
+        connection.statements.clear();
+    }
+
+    sqlite3_stmt* stmt = nullptr;
+    error = sqlite3_prepare_v3(connection.conn, sql.c_str(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if(error != SQLITE_OK){
+        std::cerr << "sqlite3_prepare_v3() failed: " << sqlite3_errmsg(connection.conn) << " in " << sql << std::endl;
+        sqlite3_finalize(stmt);
+        return nullptr;
+    }
+
+    connection.statements[sql] = stmt;
+    return stmt;
+}
+
+static int bind_params(sqlite3_stmt* stmt, const std::vector<DbValue>& params)
+{
+    for(size_t i = 0; i < params.size(); i++){
+        int index = static_cast<int>(i + 1);
+        int rc;
+
+        if(const int64_t* integer = std::get_if<int64_t>(&params[i])){
+            rc = sqlite3_bind_int64(stmt, index, *integer);
+        }else if(const double* real = std::get_if<double>(&params[i])){
+            rc = sqlite3_bind_double(stmt, index, *real);
+        }else if(const std::string* text = std::get_if<std::string>(&params[i])){
+            // The parameters outlive the statement execution, no copy needed
+            rc = sqlite3_bind_text(stmt, index, text->data(), static_cast<int>(text->size()), SQLITE_STATIC);
+        }else{
+            rc = sqlite3_bind_null(stmt, index);
+        }
+
+        if(rc != SQLITE_OK){
+            return rc;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+static DbValue column_value(sqlite3_stmt* stmt, int i)
+{
+    switch(sqlite3_column_type(stmt, i)){
+        case SQLITE_INTEGER:
+            return static_cast<int64_t>(sqlite3_column_int64(stmt, i));
+        case SQLITE_FLOAT:
+            return sqlite3_column_double(stmt, i);
+        case SQLITE_NULL:
+            return nullptr;
+        default: {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_blob(stmt, i));
+            return std::string(text ? text : "", sqlite3_column_bytes(stmt, i));
+        }
+    }
+}
+
+// Executes `sql` and passes every row to `on_row` (which returns false to stop), then records
+// its timing: the first step counts as execution, later steps and the callbacks as fetch.
+// Returns SQLITE_OK or the SQLite error code.
+static int run_statement(DbConnection& connection, const std::string& sql, const std::vector<DbValue>& params, DbResult& result,
+                         const std::function<bool(DbRow&)>& on_row, uint64_t wait_us)
+{
+    DbTiming timing;
+    timing.wait_us = wait_us;
+    auto start = std::chrono::steady_clock::now();
+
+    int error = SQLITE_OK;
+    sqlite3_stmt* stmt = prepare_statement(connection, sql, error);
+    if(stmt == nullptr){
+        return error;
+    }
+
+    if(sqlite3_bind_parameter_count(stmt) != static_cast<int>(params.size())){
+        std::cerr << "[ERROR] " << sql << " expects " << sqlite3_bind_parameter_count(stmt) << " parameters, got " << params.size() << std::endl;
+        return SQLITE_RANGE;
+    }
+
+    error = bind_params(stmt, params);
+
+    int count = sqlite3_column_count(stmt);
+    for(int i = 0; i < count; i++){
+        result.columns.push_back(sqlite3_column_name(stmt, i));
+    }
+
+    bool returned_rows = false;
+    bool first_step = true;
+    while(error == SQLITE_OK){
+        int rc = sqlite3_step(stmt);
+        if(first_step){
+            timing.execute_us = elapsed_us(start);
+            start = std::chrono::steady_clock::now();
+            first_step = false;
+        }
+        if(rc == SQLITE_DONE){
+            break;
+        }
+        if(rc != SQLITE_ROW){
+            error = rc;
+            break;
+        }
+
+        DbRow row(count);
+        for(int i = 0; i < count; i++){
+            row[i] = column_value(stmt, i);
+        }
+
+        // INSERT ... RETURNING id: the returned id stands in for mysql_insert_id()
+        if(!returned_rows && count > 0 && !sqlite3_stmt_readonly(stmt)){
+            result.insert_id = static_cast<uint64_t>(db_int(row[0]));
+        }
+        returned_rows = true;
+
+        if(!on_row(row)){
+            break;
+        }
+    }
+
+    if(error != SQLITE_OK){
+        std::cerr << "sqlite3_step() failed: " << sqlite3_errmsg(connection.conn) << " in " << sql << std::endl;
+    }else if(!sqlite3_stmt_readonly(stmt)){
+        result.affected_rows = sqlite3_changes(connection.conn);
+        if(!returned_rows && result.affected_rows > 0 && starts_with_keyword(sql, "INSERT")){
+            result.insert_id = static_cast<uint64_t>(sqlite3_last_insert_rowid(connection.conn));
+        }
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    if(first_step){
+        timing.execute_us = elapsed_us(start);
+    }else{
+        timing.fetch_us = elapsed_us(start);
+    }
+    db_record_timing(sql, params, timing);
+
+    result.ok = error == SQLITE_OK;
+    return error;
+}
+
+static int run_buffered(DbConnection& connection, const std::string& sql, const std::vector<DbValue>& params, DbResult& result,
+                        uint64_t wait_us)
+{
+    return run_statement(connection, sql, params, result, [&](DbRow& row){
+        result.rows.push_back(std::move(row));
+        return true;
+    }, wait_us);
+}
+
+int connect_db(unsigned int pool_size)
+{
+    std::lock_guard<std::mutex> writer_guard(writer_mutex);
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if(db_connected){
+        return 0;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(DB_SQLITE_PATH).parent_path(), ec);
+
+    writer = std::make_unique<DbConnection>();
+    writer->conn = open_connection(false);
+    if(writer->conn == nullptr || !exec(writer->conn, base_schema)){
+        if(writer->conn){
+            close_connection(*writer);
+        }
+        writer.reset();
+        return -1;
+    }
+
+    for(unsigned int i = 0; i < std::max(1u, pool_size); i++){
+        auto connection = std::make_unique<DbConnection>();
+        connection->conn = open_connection(true);
+        if(connection->conn == nullptr){
+            break;
+        }
+
+        idle_readers.push_back(connection.get());
+        readers.push_back(std::move(connection));
+    }
+
+    if(readers.empty()){
+        close_connection(*writer);
+        writer.reset();
+        return -1;
+    }
+
+    if(readers.size() < pool_size){
+        std::cerr << "[ERROR] Opened " << readers.size() << " of " << pool_size << " database read connections" << std::endl;
+    }
+
+    db_connected = true;
+    std::cout << "Connected to SQLite database " << DB_SQLITE_PATH << std::endl;
+    return 0;
+}
+
+int disconnect_db()
+{
+    std::lock_guard<std::mutex> writer_guard(writer_mutex);
+    std::unique_lock<std::mutex> lock(db_mutex);
+    if(!db_connected){
+        return 0;
+    }
+
+    // Wait for the readers in use, new checkouts fail from now on
+    db_connected = false;
+    db_cv.notify_all();
+    db_cv.wait(lock, [] { return idle_readers.size() == readers.size(); });
+
+    for(auto& connection : readers){
+        close_connection(*connection);
+    }
+    readers.clear();
+    idle_readers.clear();
+
+    close_connection(*writer);
+    writer.reset();
+    return 0;
+}
+
+json db_select(const std::string& query)
+{
+    ConnectionLease connection(is_read(query));
+    if(!connection){
+        return json();
+    }
+
+    DbResult result;
+    if(run_buffered(*connection, query, {}, result, connection.wait_us()) != SQLITE_OK){
+        return json();
+    }
+
+    // Same shape as the MySQL backend: every value as a string
+    json rows = json::array();
+    for(const DbRow& row : result.rows){
+        json obj = json::object();
+        for(size_t i = 0; i < result.columns.size(); i++){
+            obj[result.columns[i]] = std::holds_alternative<std::nullptr_t>(row[i]) ? "NULL" : db_string(row[i]);
+        }
+        rows.push_back(std::move(obj));
+    }
+    return rows;
+}
+
+int db_execute(const std::string& query)
+{
+    ConnectionLease connection(false);
+    if(!connection){
+        return -1;
+    }
+
+    DbResult result;
+    return run_buffered(*connection, query, {}, result, connection.wait_us()) == SQLITE_OK ? 0 : -1;
+}
+
+std::string escape_string(const std::string& str)
+{
+    std::string escaped;
+    escaped.reserve(str.size());
+
+    for(char c : str){
+        escaped += c;
+        if(c == '\''){
+            escaped += '\'';
+        }
+    }
+    return escaped;
+}
+
+json db_pool_metrics()
+{
+    size_t size, idle;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        size = readers.size();
+        idle = idle_readers.size();
+    }
+
+    uint64_t total = checkouts;
+    return {
+        {"size", size},
+        {"idle", idle},
+        {"checkouts", total},
+        {"checkout_waits", checkout_waits.load()},
+        {"checkout_timeouts", checkout_timeouts.load()},
+        {"checkout_wait_avg_us", total ? checkout_wait_us.load() / total : 0},
+        {"checkout_wait_max_us", checkout_wait_max_us.load()},
+        {"reconnects", 0}
+    };
+}
+
+const char* db_backend_name()
+{
+    return "sqlite";
+}
+
+DbResult db_query(const std::string& sql, const std::vector<DbValue>& params)
+{
+    ConnectionLease connection(is_read(sql));
+    if(!connection){
+        return DbResult();
+    }
+
+    DbResult result;
+    run_buffered(*connection, sql, params, result, connection.wait_us());
+    return result;
+}
+
+DbResult DbTransaction::query(const std::string& sql, const std::vector<DbValue>& params)
+{
+    DbResult result;
+    if(last_error != 0){
+        return result; // the transaction already failed, it will be rolled back
+    }
+
+    // The writer is already held: no wait time
+    last_error = static_cast<unsigned int>(run_buffered(connection, sql, params, result, 0));
+    return result;
+}
+
+bool db_transaction(const std::function<bool(DbTransaction&)>& body)
+{
+    ConnectionLease connection(false);
+    if(!connection){
+        return false;
+    }
+
+    sqlite3* conn = (*connection).conn;
+
+    for(int attempt = 0; attempt < 2; attempt++){
+        // IMMEDIATE takes the write lock up front: no SQLITE_BUSY halfway through the body
+        if(!exec(conn, "BEGIN IMMEDIATE")){
+            return false;
+        }
+
+        DbTransaction transaction(*connection);
+        bool ok = body(transaction) && transaction.error() == 0;
+
+        if(ok && exec(conn, "COMMIT")){
+            return true;
+        }
+
+        unsigned int error = transaction.error() ? transaction.error() : static_cast<unsigned int>(sqlite3_errcode(conn));
+        if(!sqlite3_get_autocommit(conn)){
+            exec(conn, "ROLLBACK");
+        }
+
+        if((error & 0xFF) != SQLITE_BUSY){
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool db_stream(const std::string& sql, const std::vector<DbValue>& params, const DbRowCallback& on_row)
+{
+    ConnectionLease connection(is_read(sql));
+    if(!connection){
+        return false;
+    }
+
+    DbResult result;
+    return run_statement(*connection, sql, params, result, [&](DbRow& row){
+        return on_row(result.columns, row);
+    }, connection.wait_us()) == SQLITE_OK;
+}
+
+std::string db_on_conflict_ignore(const std::string& key_columns)
+{
+    return "ON CONFLICT(" + key_columns + ") DO NOTHING";
+}
+
+std::string db_on_conflict_update(const std::string& key_columns, const std::vector<std::string>& update_columns)
+{
+    if(update_columns.empty()){
+        return db_on_conflict_ignore(key_columns);
+    }
+
+    std::string sql = "ON CONFLICT(" + key_columns + ") DO UPDATE SET ";
+    for(size_t i = 0; i < update_columns.size(); i++){
+        sql += (i ? ", " : "") + update_columns[i] + " = excluded." + update_columns[i];
+    }
+    return sql;
+}
+
+std::string db_on_conflict_id(const std::string& key_columns, const std::string& id_column)
+{
+    // The no-op update makes RETURNING yield the existing row too
+    return "ON CONFLICT(" + key_columns + ") DO UPDATE SET " + id_column + " = " + id_column + " RETURNING " + id_column;
+}
+
+std::string db_today()
+{
+    return "date('now')";
+}
+
+bool db_index_exists(const std::string& table, const std::string& index)
+{
+    DbResult result = db_query("SELECT 1 FROM sqlite_master WHERE type = 'index' AND tbl_name = ? AND name = ? LIMIT 1;", { table, index });
+    return result.ok && !result.rows.empty();
+}
+
+#endif
@@ -0,0 +1,304 @@
+#include "db_writer.hpp"
+
+#include <deque>
+#include <map>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+
+struct PendingWrite {
+    std::vector<DbWrite> rows;
+    std::chrono::steady_clock::time_point queued;
+    int attempts = 0;
+    DbWriteCallback on_done;
+};
+
+static std::deque<PendingWrite> writer_queue;
+static size_t queued_rows = 0;
+static std::mutex writer_mutex;
+static std::condition_variable writer_cv;  // wakes the writer thread
+static std::condition_variable space_cv;   // wakes producers blocked on a full queue
+static std::thread writer_thread;
+static bool writer_running = false;
+
+static std::atomic<uint64_t> rows_written = 0;
+static std::atomic<uint64_t> statements = 0;
+static std::atomic<uint64_t> flushes = 0;
+static std::atomic<uint64_t> flush_failures = 0;
+static std::atomic<uint64_t> rows_dropped = 0;
+static std::atomic<uint64_t> flush_us = 0;
+static std::atomic<uint64_t> flush_max_us = 0;
+static std::atomic<uint64_t> max_depth = 0;
+
+// Rows sharing table, columns and conflict clause go into the same INSERT
+using GroupKey = std::tuple<std::string, std::vector<std::string>, std::string>;
+
+static std::string insert_sql(const GroupKey& key, size_t rows)
+{
+    const auto& [table, columns, on_conflict] = key;
+
+    std::string tuple = "(";
+    std::string names;
+    for(size_t i = 0; i < columns.size(); i++){
+        names += (i ? ", " : "") + columns[i];
+        tuple += i ? ", ?" : "?";
+    }
+    tuple += ")";
+
+    std::string sql = "INSERT INTO " + table + "(" + names + ") VALUES " + tuple;
+    for(size_t i = 1; i < rows; i++){
+        sql += ", " + tuple;
+    }
+
+    if(!on_conflict.empty()){
+        sql += " " + on_conflict;
+    }
+    return sql;
+}
+
+// Writes every row of `batch` in one transaction. Each group is split into power-of-two runs so
+// only a handful of distinct statements ever reach the per-connection statement cache.
+static bool write_batch(const std::vector<const PendingWrite*>& batch)
+{
+    std::map<GroupKey, std::vector<const DbWrite*>> groups;
+    for(const PendingWrite* pending : batch){
+        for(const DbWrite& row : pending->rows){
+            groups[{ row.table, row.columns, row.on_conflict }].push_back(&row);
+        }
+    }
+
+    uint64_t statement_count = 0;
+    bool ok = db_transaction([&](DbTransaction& tx){
+        statement_count = 0;
+
+        for(const auto& [key, rows] : groups){
+            size_t first = 0;
+            while(first < rows.size()){
+                size_t count = DB_WRITER_BATCH_ROWS;
+                while(count > rows.size() - first){
+                    count /= 2;
+                }
+
+                std::vector<DbValue> params;
+                for(size_t i = first; i < first + count; i++){
+                    params.insert(params.end(), rows[i]->values.begin(), rows[i]->values.end());
+                }
+
+                if(!tx.query(insert_sql(key, count), params).ok){
+                    return false;
+                }
+
+                statement_count++;
+                first += count;
+            }
+        }
+
+        return true;
+    });
+
+    if(ok){
+        statements += statement_count;
+    }
+    return ok;
+}
+
+static void record_flush(uint64_t elapsed_us)
+{
+    flushes++;
+    flush_us += elapsed_us;
+
+    uint64_t max = flush_max_us;
+    while(elapsed_us > max && !flush_max_us.compare_exchange_weak(max, elapsed_us)){}
+}
+
+static void complete(const PendingWrite& pending, bool committed)
+{
+    if(committed){
+        rows_written += pending.rows.size();
+    }
+    if(pending.on_done){
+        pending.on_done(committed);
+    }
+}
+
+static void writer_loop()
+{
+    std::unique_lock<std::mutex> lock(writer_mutex);
+
+    while(true){
+        // Wait for a full batch, for the oldest write to be due, or for shutdown
+        while(writer_running && queued_rows < DB_WRITER_BATCH_ROWS){
+            if(writer_queue.empty()){
+                writer_cv.wait(lock);
+            }else if(writer_cv.wait_until(lock, writer_queue.front().queued + DB_WRITER_FLUSH_INTERVAL) == std::cv_status::timeout){
+                break;
+            }
+        }
+
+        if(writer_queue.empty()){
+            if(!writer_running){
+                return;
+            }
+            continue;
+        }
+
+        std::vector<PendingWrite> batch;
+        size_t batch_rows = 0;
+        while(!writer_queue.empty()){
+            batch_rows += writer_queue.front().rows.size();
+            batch.push_back(std::move(writer_queue.front()));
+            writer_queue.pop_front();
+        }
+        queued_rows -= batch_rows;
+        space_cv.notify_all();
+        lock.unlock();
+
+        std::vector<const PendingWrite*> batch_writes;
+        for(const PendingWrite& pending : batch){
+            batch_writes.push_back(&pending);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = write_batch(batch_writes);
+        record_flush(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+        // One transaction per call after a failed batch, so only the calls that fail on their own wait for a retry
+        std::vector<PendingWrite> failed;
+        if(!ok){
+            flush_failures++;
+            std::cerr << "[ERROR] Failed to flush " << batch_rows << " queued database writes" << std::endl;
+
+            std::vector<PendingWrite> committed;
+            for(PendingWrite& pending : batch){
+                bool alone_ok = batch.size() > 1 && write_batch({ &pending });
+                (alone_ok ? committed : failed).push_back(std::move(pending));
+            }
+            batch = std::move(committed);
+        }
+
+        for(const PendingWrite& pending : batch){
+            complete(pending, true);
+        }
+
+        if(failed.empty()){
+            lock.lock();
+            continue;
+        }
+
+        // Back to the front of the queue, in order; writes that keep failing are dropped
+        std::vector<PendingWrite> dropped;
+        lock.lock();
+        for(auto it = failed.rbegin(); it != failed.rend(); ++it){
+            if(++it->attempts >= DB_WRITER_MAX_ATTEMPTS){
+                rows_dropped += it->rows.size();
+                std::cerr << "[ERROR] Dropping " << it->rows.size() << " database writes into " << it->rows[0].table << std::endl;
+                dropped.push_back(std::move(*it));
+                continue;
+            }
+
+            queued_rows += it->rows.size();
+            writer_queue.push_front(std::move(*it));
+        }
+
+        if(!dropped.empty()){
+            lock.unlock();
+            for(PendingWrite& pending : dropped){
+                complete(pending, false);
+            }
+            lock.lock();
+        }
+
+        writer_cv.wait_for(lock, DB_WRITER_FLUSH_INTERVAL);
+    }
+}
+
+void start_db_writer()
+{
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    if(writer_running){
+        return;
+    }
+
+    writer_running = true;
+    writer_thread = std::thread(writer_loop);
+}
+
+void stop_db_writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        if(!writer_running){
+            return;
+        }
+        writer_running = false;
+    }
+
+    writer_cv.notify_all();
+    space_cv.notify_all();
+    writer_thread.join();
+}
+
+// Without the writer thread (before start, after shutdown) the rows are written in place
+static void write_now(std::vector<DbWrite> rows, DbWriteCallback on_done)
+{
+    PendingWrite pending{ std::move(rows), std::chrono::steady_clock::now(), 0, std::move(on_done) };
+
+    bool committed = write_batch({ &pending });
+    if(!committed){
+        rows_dropped += pending.rows.size();
+        std::cerr << "[ERROR] Failed to write " << pending.rows.size() << " rows into " << pending.rows[0].table << std::endl;
+    }
+    complete(pending, committed);
+}
+
+void db_write_async(std::vector<DbWrite> rows, DbWriteCallback on_done)
+{
+    if(rows.empty()){
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    space_cv.wait(lock, [] { return queued_rows < DB_WRITER_MAX_QUEUE || !writer_running; });
+
+    if(!writer_running){
+        lock.unlock();
+        write_now(std::move(rows), std::move(on_done));
+        return;
+    }
+
+    queued_rows += rows.size();
+    writer_queue.push_back({ std::move(rows), std::chrono::steady_clock::now(), 0, std::move(on_done) });
+
+    uint64_t depth = queued_rows;
+    uint64_t max = max_depth;
+    while(depth > max && !max_depth.compare_exchange_weak(max, depth)){}
+
+    if(queued_rows >= DB_WRITER_BATCH_ROWS || writer_queue.size() == 1){
+        writer_cv.notify_one();
+    }
+}
+
+json db_writer_metrics()
+{
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        depth = queued_rows;
+    }
+
+    uint64_t flush_count = flushes;
+    return {
+        {"queue_depth", depth},
+        {"queue_depth_max", max_depth.load()},
+        {"rows_written", rows_written.load()},
+        {"statements", statements.load()},
+        {"flushes", flush_count},
+        {"flush_failures", flush_failures.load()},
+        {"flush_avg_us", flush_count ? flush_us.load() / flush_count : 0},
+        {"flush_max_us", flush_max_us.load()},
+        {"rows_dropped", rows_dropped.load()}
+    };
+}
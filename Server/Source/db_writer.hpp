@@ -0,0 +1,38 @@
+#pragma once
+
+#include "db.hpp"
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+using json = nlohmann::json;
+
+// Write-behind queue for inserts nobody waits on. Rows are grouped by table into multi-row
+// INSERTs and flushed by a background thread once DB_WRITER_BATCH_ROWS are queued or the oldest
+// row waited DB_WRITER_FLUSH_INTERVAL. stop_db_writer() flushes what is left before returning.
+inline constexpr size_t DB_WRITER_BATCH_ROWS = 256;
+inline constexpr auto DB_WRITER_FLUSH_INTERVAL = std::chrono::milliseconds(200);
+inline constexpr size_t DB_WRITER_MAX_QUEUE = 100000; // producers block beyond this
+inline constexpr int DB_WRITER_MAX_ATTEMPTS = 5;
+
+struct DbWrite {
+    std::string table;
+    std::vector<std::string> columns;
+    std::vector<DbValue> values;
+    std::string on_conflict; // optional db_on_conflict_* clause, part of the grouping key
+};
+
+extern void start_db_writer();
+extern void stop_db_writer();
+
+// Runs on the writer thread once the rows are committed (true) or dropped after
+// DB_WRITER_MAX_ATTEMPTS (false); it must not block or queue further writes
+using DbWriteCallback = std::function<void(bool committed)>;
+
+// The rows of one call are committed in the same transaction. A failed flush is retried one call
+// per transaction, so a bad row only holds back the writes queued with it in the same call.
+extern void db_write_async(std::vector<DbWrite> rows, DbWriteCallback on_done = nullptr);
+extern json db_writer_metrics();
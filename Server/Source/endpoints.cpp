@@ -6,13 +6,26 @@
 #include "session.hpp"
 #include "random.hpp"
 #include "db.hpp"
+#include "db_writer.hpp"
 #include "ffmpeg.hpp"
+#include "transcode.hpp"
+#include "storyboard.hpp"
+#include "thumbnail.hpp"
+#include "upload.hpp"
+#include "upload_jobs.hpp"
+#include "crc32c.hpp"
+#include "io_engine.hpp"
+#include "metadata_cache.hpp"
+#include "video_query.hpp"
 
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <chrono>
 
 void setup_endpoints_https()
 {
@@ -22,20 +35,31 @@ void setup_endpoints_https()
 
     std::cout << "Server initialized" << std::endl;
 
+    // Retry di chunk già ricevuti: risposta prima che il client invii il corpo
+    svr.set_expect_100_continue_handler(handle_upload_expect);
+
     // telegram routes
     svr.Get("/get_files", handle_get_files);
     svr.Get("/video", handle_video);
+    svr.Get("/rendition", handle_rendition);
     svr.Get("/image", handle_image);
     svr.Post("/auth", handle_auth);
     svr.Get("/auth/get_state", handle_get_state);
     svr.Get("/logout", handle_logout);
     svr.Get("/get_chats", handle_chats);
     svr.Post("/upload", handle_upload);
+    svr.Get("/upload/status", handle_upload_status);
+    svr.Get("/upload/jobs", handle_upload_jobs);
     svr.Get("/get_user_info", handle_get_user_info);
+    svr.Get("/storyboard", handle_storyboard);
+    svr.Get("/storyboard/sheet", handle_storyboard_sheet);
 
     // db routes
     svr.Post("/set_video_data", set_video_data_handler);
     svr.Post("/get_videos_data", get_videos_data_handler);
+    svr.Get("/videos_data", handle_videos_data);
+
+    svr.Get("/metrics", handle_metrics);
 
     svr.listen("0.0.0.0", 10000);
 
@@ -52,26 +76,65 @@ void setup_endpoints_http()
 
     std::cout << "Server initialized" << std::endl;
 
+    // Retry di chunk già ricevuti: risposta prima che il client invii il corpo
+    svr.set_expect_100_continue_handler(handle_upload_expect);
+
     // telegram routes
     svr.Get("/get_files", handle_get_files);
     svr.Get("/video", handle_video);
+    svr.Get("/rendition", handle_rendition);
     svr.Get("/image", handle_image);
     svr.Post("/auth", handle_auth);
     svr.Get("/auth/get_state", handle_get_state);
     svr.Get("/logout", handle_logout);
     svr.Get("/get_chats", handle_chats);
     svr.Post("/upload", handle_upload);
+    svr.Get("/upload/status", handle_upload_status);
+    svr.Get("/upload/jobs", handle_upload_jobs);
     svr.Get("/get_user_info", handle_get_user_info);
+    svr.Get("/storyboard", handle_storyboard);
+    svr.Get("/storyboard/sheet", handle_storyboard_sheet);
 
     // db routes
     svr.Post("/set_video_data", set_video_data_handler);
     svr.Post("/get_videos_data", get_videos_data_handler);
+    svr.Get("/videos_data", handle_videos_data);
+
+    svr.Get("/metrics", handle_metrics);
 
     svr.listen("0.0.0.0", 10001);
 
     std::cout << "Server running on HTTP port 10001" << std::endl;
 }
 
+// Fetches the TDLib file object for file_id, null on timeout.
+static json get_td_file(std::shared_ptr<ClientSession> session, unsigned int file_id)
+{
+    std::string extra = "getFile_" + std::to_string(file_id) + "_" + std::to_string(rand_uint32());
+    uint32_t last_checked = 0;
+
+    session->send({
+        {"@type", "getFile"},
+        {"file_id", file_id},
+        {"@extra", extra}
+        });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(TDLIB_TIMEOUT);
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        auto responses = session->getResponses()->get_all_for(last_checked, std::chrono::milliseconds(500));
+
+        for (const auto& [id, resp] : responses) {
+            last_checked = id;
+            if (resp.value("@extra", "") == extra) {
+                return resp["@type"] == "file" ? resp : json();
+            }
+        }
+    }
+
+    return json();
+}
+
 int handle_chats(const httplib::Request& req, httplib::Response& res)
 {
     // Parse query string da req (in httplib è già divisa)
@@ -97,16 +160,143 @@ int handle_chats(const httplib::Request& req, httplib::Response& res)
                 }
     );*/
 
-    std::vector<json> chats = get_chats(getSession(session_id));
-    std::string json_str = json(chats).dump();
+    std::shared_ptr<ClientSession> session = getSession(session_id);
+    ChatListCache& cache = session->getChatCache();
+
+    // Solo la prima richiesta interroga TDLib: poi la cache è tenuta aggiornata dagli update
+    if (!cache.loaded()) {
+        std::vector<json> chats = get_chats(session);
+        if (!chats.empty()) {
+            cache.load(chats);
+        }
+    }
+
+    auto [etag, json_str] = cache.snapshot();
 
-    res.status = 200;
     res.set_header("Access-Control-Allow-Origin", "*");
-    res.set_header("Content-Type", "application/json");
+    res.set_header("Access-Control-Expose-Headers", "ETag");
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("ETag", etag);
+
+    if (req.get_header_value("If-None-Match") == etag) {
+        res.status = 304;
+        return 304;
+    }
+
+    res.status = 200;
     res.set_content(json_str, "application/json");
     return 200;
 }
 
+static std::map<std::pair<unsigned int, uint32_t>, std::string> video_unique_ids;
+static std::mutex video_unique_ids_mutex;
+
+// Unique id of a Telegram file, remembered per (file_id, session) after the first lookup
+static std::string file_unique_id(std::shared_ptr<ClientSession> session, unsigned int file_id, uint32_t session_id)
+{
+    std::pair<unsigned int, uint32_t> key = std::make_pair(file_id, session_id);
+    {
+        std::lock_guard<std::mutex> lock(video_unique_ids_mutex);
+        auto it = video_unique_ids.find(key);
+        if (it != video_unique_ids.end()) return it->second;
+    }
+
+    json file = get_td_file(session, file_id);
+    if (file.is_null() || !file.contains("remote") || !file["remote"].contains("unique_id")) {
+        return "";
+    }
+
+    std::string unique_id = file["remote"]["unique_id"];
+    std::lock_guard<std::mutex> lock(video_unique_ids_mutex);
+    video_unique_ids[key] = unique_id;
+    return unique_id;
+}
+
+// Serves a finished rendition (e.g. quality=360p) under its own URL: every range of a stream comes
+// from the same file, so Content-Range totals never change between responses. No fallback to the
+// original: 404 until the rendition exists, 416 past its end; the client then plays /video.
+int handle_rendition(const httplib::Request& req, httplib::Response& res)
+{
+    if (!req.has_param("file_id") || !req.has_param("session_id") || !req.has_param("quality")) {
+        std::cerr << "[ERROR] Missing file_id, session_id or quality parameter in request." << std::endl;
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Missing file_id, session_id or quality parameter\"}", "application/json");
+        return 400;
+    }
+
+    unsigned int file_id = std::stoul(req.get_param_value("file_id"));
+    uint32_t session_id = std::stoul(req.get_param_value("session_id"));
+    std::string quality = req.get_param_value("quality");
+
+    if (!is_valid_quality(quality)) {
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Unknown quality\"}", "application/json");
+        return 400;
+    }
+
+    std::string unique_id = file_unique_id(getSession(session_id), file_id, session_id);
+    std::string rendition = unique_id.empty() ? "" : transcode_get_rendition(unique_id, quality);
+
+    std::error_code ec;
+    size_t file_size = rendition.empty() ? 0 : std::filesystem::file_size(rendition, ec);
+    if (rendition.empty() || ec || file_size == 0) {
+        res.status = 404;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Rendition not available\"}", "application/json");
+        return 404;
+    }
+
+    // Stessa politica di /video per i range aperti
+    size_t start = 0, end = 1024 * 1024 - 1;
+    std::string range_header = req.get_header_value("Range");
+    if (!range_header.empty()) {
+        int matched = sscanf(range_header.c_str(), "bytes=%zu-%zu", &start, &end);
+        if (matched == 1) {
+            end = start + (start == 0 ? 4096 * 4096 : 4096 * 1024) - 1;
+        }
+        else if (matched != 2 || end < start) {
+            res.status = 416;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content("{\"error\": \"Invalid Range header format\"}", "application/json");
+            return 416;
+        }
+    }
+
+    if (start >= file_size) {
+        res.status = 416;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Content-Range", "bytes */" + std::to_string(file_size));
+        return 416;
+    }
+
+    if (end >= file_size) {
+        end = file_size - 1;
+    }
+
+    size_t length = end - start + 1;
+    std::string buffer(length, '\0');
+    if (!io_read_file(rendition, start, buffer.data(), length)) {
+        std::cerr << "[ERROR] Could not read " << length << " bytes from " << rendition << std::endl;
+        res.status = 500;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Could not read full range\"}", "application/json");
+        return 500;
+    }
+
+    res.status = 206;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_header("Accept-Ranges", "bytes");
+    res.set_header("Connection", "keep-alive");
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("X-Rendition", quality);
+    res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" +
+        std::to_string(end) + "/" + std::to_string(file_size));
+    res.set_content(std::move(buffer), "video/mp4");
+    return 206;
+}
+
 int handle_video(const httplib::Request& req, httplib::Response& res)
 {
     //std::cout << "Received request for video" << std::endl;
@@ -181,6 +371,22 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
     //std::cout << "Requested Range: " << start << " - " << end << std::endl;
 
     std::shared_ptr<ClientSession> session = getSession(session_id);
+    std::pair<unsigned int, uint32_t> key = std::make_pair(file_id, session_id);
+
+    // Counts the view once the file identity is known; renditions are served by /rendition
+    auto check_file = [&](const json& file) {
+        if (!file.contains("remote") || !file["remote"].contains("unique_id")) {
+            return;
+        }
+
+        std::string unique_id = file["remote"]["unique_id"];
+        {
+            std::lock_guard<std::mutex> lock(video_unique_ids_mutex);
+            video_unique_ids[key] = unique_id;
+        }
+
+        transcode_record_view(unique_id, file["local"]["path"].get<std::string>(), file["local"]["is_downloading_completed"].get<bool>());
+    };
 
     // Richiedi a Telegram di scaricare la porzione richiesta
     session->send({
@@ -193,7 +399,7 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
         });
 
     static std::map<std::pair<unsigned int, uint32_t>, uint32_t> last_checked_map;
-    std::pair<unsigned int, uint32_t> key = std::make_pair(file_id, session_id);
+    bool file_checked = false;
 
     while (true) {
         auto responses = session->getResponses()->get_all(last_checked_map[key]);
@@ -204,6 +410,11 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
             if (!response.is_null() && response["@type"] == "updateFile") {
                 //std::cout << response.dump(4) << std::endl;
                 if (response["file"]["id"] == file_id) {
+                    if (!file_checked) {
+                        file_checked = true;
+                        check_file(response["file"]);
+                    }
+
                     bool downloading_active = response["file"]["local"]["is_downloading_active"];
                     size_t available_start = response["file"]["local"]["download_offset"];
                     size_t available_prefix = response["file"]["local"]["downloaded_prefix_size"];
@@ -227,24 +438,11 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
 
                     // Verifica se la parte richiesta è già scaricata
                     if (start >= available_start && end <= available_end && !downloading_active) {
-                        std::ifstream file(file_path, std::ios::binary);
-                        if (!file) {
-                            std::cerr << "[ERROR] Failed to open file: " << file_path << std::endl;
-                            res.status = 500;
-                            res.set_header("Access-Control-Allow-Origin", "*");
-                            res.set_content("{\"error\": \"Failed to open file\"}", "application/json");
-                            return 500;
-                        }
-
+                        // Letto direttamente nella stringa della risposta, senza buffer intermedio
                         size_t length = end - start + 1;
-                        file.seekg(start);
-                        std::vector<char> buffer(length);
-                        file.read(buffer.data(), length);
-                        size_t actually_read = file.gcount();
-                        file.close();
-
-                        if (actually_read != length) {
-                            std::cerr << "[ERROR] Only read " << actually_read << " bytes instead of " << length << std::endl;
+                        std::string buffer(length, '\0');
+                        if (!io_read_file(file_path.u8string(), start, buffer.data(), length)) {
+                            std::cerr << "[ERROR] Could not read " << length << " bytes from " << file_path << std::endl;
                             res.status = 500;
                             res.set_header("Access-Control-Allow-Origin", "*");
                             res.set_content("{\"error\": \"Could not read full range\"}", "application/json");
@@ -263,13 +461,18 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
                         res.set_header("Content-Length", std::to_string(length));
                         res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" +
                             std::to_string(end) + "/" + std::to_string(file_size));
-                        res.set_content(std::string(buffer.begin(), buffer.end()), "video/mp4");
+                        res.set_content(std::move(buffer), "video/mp4");
                         return 206;
                     }
                 }
             }else if (!response.is_null() && response["@type"] == "file") {
                 //std::cout << response.dump(4) << std::endl;
                 if (response["id"] == file_id) {
+                    if (!file_checked) {
+                        file_checked = true;
+                        check_file(response);
+                    }
+
                     bool downloading_active = response["local"]["is_downloading_active"];
                     size_t available_start = response["local"]["download_offset"];
                     size_t available_prefix = response["local"]["downloaded_prefix_size"];
@@ -292,24 +495,11 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
 
                     // Verifica se la parte richiesta è già scaricata
                     if (start >= available_start && end <= available_end && !downloading_active) {
-                        std::ifstream file(file_path, std::ios::binary);
-                        if (!file) {
-                            std::cerr << "[ERROR] Failed to open file: " << file_path << std::endl;
-                            res.status = 500;
-                            res.set_header("Access-Control-Allow-Origin", "*");
-                            res.set_content("{\"error\": \"Failed to open file\"}", "application/json");
-                            return 500;
-                        }
-
+                        // Letto direttamente nella stringa della risposta, senza buffer intermedio
                         size_t length = end - start + 1;
-                        file.seekg(start - available_start);
-                        std::vector<char> buffer(length);
-                        file.read(buffer.data(), length);
-                        size_t actually_read = file.gcount();
-                        file.close();
-
-                        if (actually_read != length) {
-                            std::cerr << "[ERROR] Only read " << actually_read << " bytes instead of " << length << std::endl;
+                        std::string buffer(length, '\0');
+                        if (!io_read_file(file_path.u8string(), start - available_start, buffer.data(), length)) {
+                            std::cerr << "[ERROR] Could not read " << length << " bytes from " << file_path << std::endl;
                             res.status = 500;
                             res.set_header("Access-Control-Allow-Origin", "*");
                             res.set_content("{\"error\": \"Could not read full range\"}", "application/json");
@@ -328,7 +518,7 @@ int handle_video(const httplib::Request& req, httplib::Response& res)
                         res.set_header("Content-Length", std::to_string(length));
                         res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" +
                             std::to_string(end) + "/" + std::to_string(file_size));
-                        res.set_content(std::string(buffer.begin(), buffer.end()), "video/mp4");
+                        res.set_content(std::move(buffer), "video/mp4");
                         return 206;
                     }
                 }
@@ -578,11 +768,9 @@ int set_video_data_handler(const httplib::Request& req, httplib::Response& res)
     // campi testuali
     if (req.has_file("title")) {
         title = req.get_file_value("title").content;
-        title = escape_string(title);
     }
     if (req.has_file("description")) {
         description = req.get_file_value("description").content;
-        description = escape_string(description);
     }
     if (req.has_file("chat_id")) {
         chat_id = std::stoll(req.get_file_value("chat_id").content);
@@ -591,6 +779,16 @@ int set_video_data_handler(const httplib::Request& req, httplib::Response& res)
         message_id = std::stoll(req.get_file_value("message_id").content);
     }
 
+    // Opzionali: usati per estrarre la copertina dal video se non viene inviata un'immagine
+    uint32_t session_id = 0;
+    unsigned int file_id = 0;
+    if (req.has_file("session_id")) {
+        session_id = std::stoul(req.get_file_value("session_id").content);
+    }
+    if (req.has_file("file_id")) {
+        file_id = std::stoul(req.get_file_value("file_id").content);
+    }
+
     //immagine
     std::string original_filename, image_data, extension;
     if (req.has_file("image")) {
@@ -602,28 +800,64 @@ int set_video_data_handler(const httplib::Request& req, httplib::Response& res)
         image_data = file.content;
     }
 
-    // salvataggio immagine e inserimento nel db
-    if (!title.empty() && !description.empty() && !image_data.empty()) {
-        if (!std::filesystem::exists("UserData/Thumbnails")) {
-            std::filesystem::create_directory("UserData/Thumbnails");
+    if (!std::filesystem::exists("UserData/Thumbnails")) {
+        std::filesystem::create_directories("UserData/Thumbnails");
+    }
+
+    std::string uploaded_filename;
+    if (!title.empty() && !description.empty()) {
+        if (!image_data.empty()) {
+            uploaded_filename = "UserData/Thumbnails/" + random_string(20) + extension;
+            std::ofstream image_file(uploaded_filename, std::ios::binary);
+            image_file.write(image_data.c_str(), image_data.size());
+            image_file.close();
+
+            generate_image_variants(uploaded_filename);
         }
+        else {
+            // Nessuna immagine: usa la copertina estratta durante l'upload, oppure estraila dal video scaricato
+            std::string poster = poster_path(chat_id, message_id);
 
-        std::string uploaded_filename = "UserData/Thumbnails/" + random_string(20) + extension;
-        std::ofstream image_file(uploaded_filename, std::ios::binary);
-        image_file.write(image_data.c_str(), image_data.size());
-        image_file.close();
+            if (!std::filesystem::exists(poster) && session_id != 0 && file_id != 0) {
+                json file = get_td_file(getSession(session_id), file_id);
+                if (!file.is_null() && file["local"]["downloaded_prefix_size"].get<int64_t>() > 0) {
+                    extract_poster(file["local"]["path"].get<std::string>(), poster);
+                }
+            }
 
-        json jres = db_select("SELECT * FROM telegram_video WHERE chat_id = " + std::to_string(chat_id) + " AND message_id = " + std::to_string(message_id) + ";");
-        if (jres.empty()) {
-            db_execute("INSERT INTO telegram_video (chat_id, message_id) VALUES (" + std::to_string(chat_id) + ", " + std::to_string(message_id) + ");");
+            if (std::filesystem::exists(poster)) {
+                uploaded_filename = poster;
+                original_filename = std::filesystem::path(poster).filename().string();
+            }
         }
+    }
+
+    // inserimento nel db
+    if (!uploaded_filename.empty()) {
 
-        db_execute("INSERT INTO image(original_filename, saved_filename) VALUES ('" + original_filename + "', '" + uploaded_filename + "');");
+        // Un'unica transazione: l'upsert restituisce anche l'id della riga già esistente
+        bool saved = db_transaction([&](DbTransaction& tx) {
+            int64_t video_id = tx.query("INSERT INTO telegram_video (chat_id, message_id) VALUES (?, ?) " + db_on_conflict_id("chat_id, message_id", "id"),
+                { chat_id, message_id }).insert_id;
+            int64_t image_id = tx.query("INSERT INTO image(original_filename, saved_filename) VALUES (?, ?)",
+                { original_filename, uploaded_filename }).insert_id;
+
+            if (video_id == 0 || image_id == 0) {
+                return false;
+            }
 
-        unsigned int image_id = std::stoul(db_select("SELECT id FROM image WHERE original_filename = '" + original_filename + "' AND saved_filename = '" + uploaded_filename + "';")[0]["id"].get<std::string>());
-        unsigned int video_id = std::stoul(db_select("SELECT id FROM telegram_video WHERE chat_id = " + std::to_string(chat_id) + " AND message_id = " + std::to_string(message_id) + ";")[0]["id"].get<std::string>());
+            return tx.query("INSERT INTO video(title, description, data_caricamento, telegram_video_id, thumbnail_id) VALUES (?, ?, " + db_today() + ", ?, ?)",
+                { title, description, video_id, image_id }).ok;
+            });
 
-        db_execute("INSERT INTO video(title, description, data_caricamento, telegram_video_id, thumbnail_id) VALUES ('" + title + "', '" + description + "', CURDATE(), " + std::to_string(video_id) + ", " + std::to_string(image_id) + ");");
+        metadata_cache_invalidate(chat_id, message_id);
+
+        if (!saved) {
+            res.status = 500;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content(R"({"status": "error", "message": "Database error"})", "application/json");
+            return 500;
+        }
 
         res.status = 200;
         res.set_header("Access-Control-Allow-Origin", "*");
@@ -634,6 +868,7 @@ int set_video_data_handler(const httplib::Request& req, httplib::Response& res)
         std::string error_msg = "Missing required parameters: ";
         if (title.empty()) error_msg += "title ";
         if (description.empty()) error_msg += "description ";
+        if (uploaded_filename.empty()) error_msg += "image ";
         if (chat_id == 0) error_msg += "chat_id ";
 
         res.status = 400;
@@ -669,36 +904,67 @@ int get_videos_data_handler(const httplib::Request& req, httplib::Response& res)
             return 400;
         }
 
+        auto started = std::chrono::steady_clock::now();
         int64_t chat_id = std::stoll(request_json["chat_id"].get<std::string>());
-        json out;
+        json out = json::array();
 
-        // Process each video in the "videos" array
+        // Una sola query per tutti i message_id invece di due per video
+        std::vector<int64_t> message_ids;
         for (const auto& video : request_json["videos"]) {
-            int64_t message_id = video["message_id"];
-             
-            // Query the database for the video
-            json res_db = db_select("SELECT * FROM telegram_video WHERE chat_id = " + std::to_string(chat_id) + " AND message_id = " + std::to_string(message_id) + ";");
-
-            // If no result, add the video to the response
-            if (res_db.empty()) {
-                out.push_back(video);
+            message_ids.push_back(video["message_id"].get<int64_t>());
+        }
+        std::sort(message_ids.begin(), message_ids.end());
+        message_ids.erase(std::unique(message_ids.begin(), message_ids.end()), message_ids.end());
+
+        // Prima la cache, poi una sola query per i message_id mancanti
+        std::unordered_map<int64_t, json> latest;
+        std::vector<int64_t> missing;
+        for (int64_t message_id : message_ids) {
+            std::optional<json> meta;
+            if (!metadata_cache_get(chat_id, message_id, meta)) {
+                missing.push_back(message_id);
             }
-            else {
-                unsigned int db_video_id = std::stoi(res_db[0]["id"].get<std::string>());
+            else if (meta) {
+                latest[message_id] = std::move(*meta);
+            }
+        }
+
+        if (!missing.empty()) {
+            uint64_t generation = metadata_cache_generation();
+            std::unordered_map<int64_t, json> loaded;
+            bool complete = select_latest_videos(chat_id, missing, loaded);
 
-                // Query the video data
-                res_db = db_select("SELECT * FROM video WHERE telegram_video_id = " + std::to_string(db_video_id) + " ORDER BY id DESC;");
-                if (res_db.empty()) {
-                    out.push_back(video);
+            for (int64_t message_id : missing) {
+                auto found = loaded.find(message_id);
+                if (found != loaded.end()) {
+                    metadata_cache_put(chat_id, message_id, found->second, generation);
+                    latest[message_id] = std::move(found->second);
                 }
-                else {
-                    res_db = res_db[0];
-                    res_db["telegram_data"] = video;
-                    out.push_back(res_db);
+                else if (complete) {
+                    // Nessun metadato: memorizzato anche questo
+                    metadata_cache_put(chat_id, message_id, std::nullopt, generation);
                 }
             }
         }
 
+        // Merge in memoria, stesso ordine della richiesta
+        for (const auto& video : request_json["videos"]) {
+            auto found = latest.find(video["message_id"].get<int64_t>());
+            if (found == latest.end()) {
+                out.push_back(video);
+            }
+            else {
+                json row = found->second;
+                row["telegram_data"] = video;
+                out.push_back(row);
+            }
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "get_videos_data: " << out.size() << " videos, " << latest.size() << " with data, "
+                  << missing.size() << " from the database in " << elapsed.count() / 1000.0 << " ms" << std::endl;
+        res.set_header("Server-Timing", "db;dur=" + std::to_string(elapsed.count() / 1000.0));
+
         // Send response
         res.status = 200;
         res.set_header("Access-Control-Allow-Origin", "*");
@@ -715,10 +981,130 @@ int get_videos_data_handler(const httplib::Request& req, httplib::Response& res)
     }
 }
 
-static std::unordered_map<std::string, std::shared_ptr<std::mutex>> file_mutexes;
-static std::unordered_map<std::string, uint64_t> preallocated_files;
+// Tutti i video con metadati di una chat, scritti nella risposta chunked una pagina alla volta.
+// Ogni pagina è una query a sé (keyset su message_id): la connessione torna al pool prima di
+// scrivere sul socket, così un client lento non tiene occupato il pool. Valori come stringhe,
+// lo stesso formato di get_videos_data.
+int handle_videos_data(const httplib::Request& req, httplib::Response& res)
+{
+    int64_t chat_id = 0;
+    try {
+        chat_id = std::stoll(req.get_param_value("chat_id"));
+    }
+    catch (const std::exception&) {
+        std::cerr << "[ERROR] Missing chat_id parameter in request." << std::endl;
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Missing chat_id parameter\"}", "application/json");
+        return 400;
+    }
+
+    res.status = 200;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_chunked_content_provider("application/json", [chat_id](size_t, httplib::DataSink& sink) {
+        std::string buffer = "[";
+        bool first = true;
+        int64_t before_message_id = std::numeric_limits<int64_t>::max();
+
+        while (true) {
+            std::vector<json> rows;
+            int64_t last_message_id = 0;
+
+            // Errore a metà: la connessione viene chiusa e il client riceve un JSON troncato
+            if (!select_chat_videos_page(chat_id, before_message_id, rows, last_message_id)) {
+                return false;
+            }
+
+            for (const json& row : rows) {
+                if (!first) {
+                    buffer += ',';
+                }
+                first = false;
+                buffer += row.dump();
+
+                if (buffer.size() >= STREAM_CHUNK_SIZE) {
+                    if (!sink.write(buffer.data(), buffer.size())) {
+                        return false;
+                    }
+                    buffer.clear();
+                }
+            }
+
+            if (rows.size() < static_cast<size_t>(VIDEOS_DATA_PAGE_ROWS)) {
+                break;
+            }
+            before_message_id = last_message_id;
+        }
+
+        buffer += ']';
+        if (!sink.write(buffer.data(), buffer.size())) {
+            return false;
+        }
+        sink.done();
+        return true;
+        });
 
-int handle_upload(const httplib::Request& req, httplib::Response& res)
+    return 200;
+}
+
+// Parses the optional chunk_crc32c header; false if present but malformed.
+static bool get_chunk_checksum(const httplib::Request& req, std::optional<uint32_t>& checksum)
+{
+    checksum.reset();
+    if (!req.has_header("chunk_crc32c")) {
+        return true;
+    }
+
+    uint32_t crc;
+    if (!parse_crc32c(req.get_header_value("chunk_crc32c"), crc)) {
+        return false;
+    }
+
+    checksum = crc;
+    return true;
+}
+
+int handle_upload_expect(const httplib::Request& req, httplib::Response& res)
+{
+    if (req.path != "/upload") {
+        return 100;
+    }
+
+    unsigned long long start, end, size;
+    std::optional<uint32_t> checksum;
+    auto range = req.get_header_value("Content-Range");
+    if (sscanf(range.c_str(), "bytes %llu-%llu/%llu", &start, &end, &size) != 3 || start > end || !get_chunk_checksum(req, checksum)) {
+        return 100; // handle_upload reports the error
+    }
+
+    std::string file_path = "tmp/" + std::filesystem::u8path(req.get_header_value("file_name")).filename().u8string();
+    std::shared_ptr<UploadFile> upload = find_upload(file_path);
+    if (!upload || upload->size != size) {
+        return 100;
+    }
+
+    switch (upload_check_chunk(*upload, start, end + 1, checksum)) {
+    case ChunkCheck::Received:
+        res.status = 200;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("OK", "text/plain");
+        return 200;
+    case ChunkCheck::Mismatch:
+        res.status = 409;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("Checksum mismatch", "text/plain");
+        return 409;
+    case ChunkCheck::Overlap:
+        res.status = 409;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("Overlapping chunk", "text/plain");
+        return 409;
+    default:
+        return 100;
+    }
+}
+
+int handle_upload(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& content_reader)
 {
     auto range = req.get_header_value("Content-Range");
     auto session_id_h = req.get_header_value("session_id");
@@ -734,8 +1120,24 @@ int handle_upload(const httplib::Request& req, httplib::Response& res)
     }
 
     if (!range.empty()) {
-        int start, end, size;
-        if (sscanf(range.c_str(), "bytes %d-%d/%d", &start, &end, &size) != 3) {
+        // Letti una volta sola e prima di riservare il chunk: un'eccezione dopo upload_claim_chunk
+        // lascerebbe il range riservato, dopo upload_mark_received l'upload completo senza job
+        uint32_t session_id = 0;
+        int64_t chat_id = 0;
+        try {
+            session_id = std::stoul(session_id_h);
+            chat_id = std::stoll(chat_id_h);
+        }
+        catch (const std::exception&) {
+            std::cerr << "[ERROR] Missing or invalid session_id/chat_id header in upload request" << std::endl;
+            res.status = 400;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content("Missing or invalid session_id/chat_id header", "text/plain");
+            return 400;
+        }
+
+        unsigned long long start, end, size;
+        if (sscanf(range.c_str(), "bytes %llu-%llu/%llu", &start, &end, &size) != 3 || start > end || end >= size) {
             std::cerr << "[ERROR] Invalid Range header format" << std::endl;
             res.status = 416;
             res.set_header("Access-Control-Allow-Origin", "*");
@@ -743,29 +1145,24 @@ int handle_upload(const httplib::Request& req, httplib::Response& res)
             return 416;
         }
 
-        std::string file_path = "tmp/" + std::string(file_name_h);
-
-        if (!std::filesystem::exists("tmp")) {
-            std::filesystem::create_directory("tmp");
+        std::optional<uint32_t> checksum;
+        if (!get_chunk_checksum(req, checksum)) {
+            std::cerr << "[ERROR] Invalid chunk_crc32c header" << std::endl;
+            res.status = 400;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content("Invalid chunk_crc32c header", "text/plain");
+            return 400;
         }
 
-        auto& file_mutex = file_mutexes[file_name_h];
-        if (!file_mutex) file_mutex = std::make_shared<std::mutex>();
-
-        std::unique_lock<std::mutex> lock(*file_mutex, std::defer_lock);
-
-        lock.lock();
+        // Solo il nome del file, mai un percorso
+        std::string file_path = "tmp/" + std::filesystem::u8path(file_name_h).filename().u8string();
 
-        if (preallocated_files.find(file_path) == preallocated_files.end()) {
-            std::ofstream prealloc(file_path, std::ios::binary | std::ios::trunc);
-            prealloc.seekp(size - 1);
-            prealloc.write("", 1); // Preallocate size bytes
-            prealloc.close();
-            preallocated_files[file_path] = 0;
+        if (!std::filesystem::exists("tmp")) {
+            std::filesystem::create_directory("tmp");
         }
 
-        std::ofstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
-        if (!file) {
+        std::shared_ptr<UploadFile> upload = open_upload(file_path, size);
+        if (!upload || upload->size != size) {
             std::cerr << "[ERROR] Failed to open file: " << file_path << std::endl;
             res.status = 500;
             res.set_header("Access-Control-Allow-Origin", "*");
@@ -773,101 +1170,85 @@ int handle_upload(const httplib::Request& req, httplib::Response& res)
             return 500;
         }
 
-        file.seekp(start);
-        file.write(req.body.c_str(), req.body.size());
-
-        preallocated_files[file_path] += req.body.size();
-
-        if (preallocated_files[file_path] == size) {
-            lock.unlock();
-
-            std::string local_path = std::filesystem::absolute(file_path).string();
-            // Sometimes Telegram is not able to get video metadata, so I do it here manually.
-            VideoMetadata meta = get_video_metadata(local_path);
-            int64_t chat_id = std::stoll(chat_id_h);
-            uint32_t session_id = std::stoul(session_id_h);
-
-            std::thread([=]() {
-                std::shared_ptr<ClientSession> session = getSession(session_id);
-
-                if ((meta.valid)) {
-                    session->send({
-                        {"@type", "sendMessage"},
-                        {"chat_id", chat_id},
-                        {"input_message_content", {
-                            {"@type", "inputMessageVideo"},
-                            {"video", {
-                                {"@type", "inputFileLocal"},
-                                {"path", local_path}
-                            }},
-                            {"duration", meta.duration},
-                            {"width", meta.width},
-                            {"height", meta.height},
-                            {"supports_streaming", true}
-                        }}
-                    });
-                }else {
-                    session->send({
-                        {"@type", "sendMessage"},
-                        {"chat_id", chat_id},
-                        {"input_message_content", {
-                            {"@type", "inputMessageVideo"},
-                            {"video", {
-                                {"@type", "inputFileLocal"},
-                                {"path", local_path}
-                            }},
-                            {"supports_streaming", true}
-                        }}
-                        });
-                }
+        // Chunk già ricevuto (retry) o sovrapposto a byte ricevuti o in scrittura: nessuna scrittura,
+        // basta consumare il corpo. Solo i byte liberi vengono riservati a questa richiesta
+        ChunkCheck check = upload_claim_chunk(*upload, start, end + 1, checksum);
+        if (check != ChunkCheck::Missing) {
+            content_reader([](const char*, size_t) { return true; });
 
-                uint32_t last_checked = 0;
-                bool uploaded = false;
-                int64_t message_id = 0;
+            res.status = check == ChunkCheck::Received ? 200 : 409;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content(check == ChunkCheck::Received ? "OK" : check == ChunkCheck::Mismatch ? "Checksum mismatch" : "Overlapping chunk", "text/plain");
+            return res.status;
+        }
 
-                while (!uploaded || message_id == 0) {
-                    auto responses = session->getResponses()->get_all(last_checked);
+        // I file grandi partono verso Telegram già dal primo chunk (vedi upload_jobs)
+        if (UPLOAD_PIPELINE_ENABLED && size >= UPLOAD_PIPELINE_MIN_SIZE) {
+            enqueue_upload_job(file_path, session_id, chat_id, true);
+        }
 
-                    for (auto r = responses.rbegin(); r != responses.rend(); r++) {
-                        json response = r->second;
+        // Il file resta aperto finché questo chunk lo usa, anche se l'upload viene chiuso nel frattempo
+        StagingFileUse file_use(*upload);
+        if (!file_use) {
+            upload_release_chunk(*upload, start);
+            content_reader([](const char*, size_t) { return true; });
 
-                        if (!response.is_null() && response["@type"] == "updateFile") {
-                            std::string res_file_path = response["file"]["local"]["path"];
-                            bool upload_complete = response["file"]["remote"]["is_uploading_completed"];
+            bool completed = upload->completed;
+            res.status = completed ? 200 : 409;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content(completed ? "OK" : "Upload closed", "text/plain");
+            return res.status;
+        }
 
-                            if (!uploaded && upload_complete && res_file_path == local_path) {
-                                std::filesystem::remove(local_path);
-                                uploaded = true;
-                            }
-                        }
+        // Il corpo del chunk viene scritto direttamente su disco man mano che arriva,
+        // e se il chunk è il prossimo in ordine anche aggiunto all'hash del contenuto
+        ChunkWriter writer(upload->file, start);
+        ChunkHasher hasher(*upload, start);
+        uint64_t written = 0;
+        uint64_t expected = end - start + 1;
+        uint32_t crc = 0;
+        bool write_ok = true;
+
+        content_reader([&](const char* data, size_t length) {
+            if (written + length > expected || !writer.write(data, length)) {
+                write_ok = false;
+                return false;
+            }
 
-                        if (!response.is_null() && message_id == 0 && response["@type"] == "updateNewMessage") {
-                            const json& msg = response["message"];
+            if (checksum) {
+                crc = crc32c(crc, data, length);
+            }
 
-                            if (msg.contains("chat_id") && msg["chat_id"] == chat_id &&
-                                msg.contains("content") &&
-                                msg["content"].contains("video") &&
-                                msg["content"]["video"]["video"]["local"]["path"] == local_path) {
+            hasher.update(data, length);
+            written += length;
+            return true;
+        });
 
-                                message_id = msg["id"];
+        if (!write_ok || written != expected || !writer.flush()) {
+            upload_release_chunk(*upload, start);
+            std::cerr << "[ERROR] Incomplete chunk " << range << " for " << file_path << std::endl;
+            res.status = 400;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content("Incomplete chunk", "text/plain");
+            return 400;
+        }
 
-                                db_execute("INSERT INTO telegram_video(message_id, chat_id) VALUES(" + std::to_string(message_id) + ", " + std::to_string(chat_id) + ");");
-                            }
-                        }
+        // Chunk corrotto: i byte scritti erano liberi e riservati a questa richiesta, restano
+        // fuori da received e il retry li sovrascrive
+        if (checksum && crc != *checksum) {
+            upload_release_chunk(*upload, start);
+            std::cerr << "[ERROR] Checksum mismatch on chunk " << range << " for " << file_path << std::endl;
+            res.status = 400;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content("Checksum mismatch", "text/plain");
+            return 400;
+        }
 
-                        if (message_id && uploaded) {
-                            break;
-                        }
-                    }
+        hasher.commit();
 
-                    if (!responses.empty()) {
-                        last_checked = responses.rbegin()->first;
-                    }
-                }
-                }).detach();
-        }
-        else {
-            lock.unlock();
+        // Completo solo quando ogni byte è coperto, indipendentemente da retry e ordine dei chunk
+        if (upload_mark_received(*upload, start, end + 1, checksum)) {
+            enqueue_upload_job(file_path, session_id, chat_id);
         }
 
         res.status = 200;
@@ -882,6 +1263,68 @@ int handle_upload(const httplib::Request& req, httplib::Response& res)
     return 200;
 }
 
+int handle_upload_status(const httplib::Request& req, httplib::Response& res)
+{
+    if (!req.has_param("file_name")) {
+        std::cerr << "[ERROR] Missing file_name parameter in request." << std::endl;
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Missing file_name parameter\"}", "application/json");
+        return 400;
+    }
+
+    std::string file_path = "tmp/" + std::filesystem::u8path(req.get_param_value("file_name")).filename().u8string();
+    std::shared_ptr<UploadFile> upload = find_upload(file_path);
+
+    if (!upload) {
+        res.status = 404;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Unknown upload\"}", "application/json");
+        return 404;
+    }
+
+    json status;
+    {
+        std::lock_guard<std::mutex> lock(upload->mutex);
+
+        // Stesso formato di Content-Range: estremi inclusi
+        json missing = json::array();
+        for (const auto& [start, end] : upload->received.missing(upload->size)) {
+            missing.push_back({ start, end - 1 });
+        }
+
+        status = {
+            {"size", upload->size},
+            {"received", upload->received.covered()},
+            {"complete", upload->completed.load()},
+            {"missing", missing}
+        };
+    }
+
+    res.status = 200;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_content(status.dump(), "application/json");
+    return 200;
+}
+
+int handle_upload_jobs(const httplib::Request& req, httplib::Response& res)
+{
+    if (!req.has_param("session_id")) {
+        std::cerr << "[ERROR] Missing session_id parameter in request." << std::endl;
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Missing session_id parameter\"}", "application/json");
+        return 400;
+    }
+
+    json jobs = get_upload_jobs(std::stoul(req.get_param_value("session_id")));
+
+    res.status = 200;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_content(jobs.dump(), "application/json");
+    return 200;
+}
+
 int handle_image(const httplib::Request& req, httplib::Response& res)
 {
     unsigned int image_id = req.has_param("id") ? std::stoul(req.get_param_value("id")) : std::numeric_limits<unsigned int>::max();
@@ -893,20 +1336,23 @@ int handle_image(const httplib::Request& req, httplib::Response& res)
         return 400;
     }
 
-    std::string file_path = db_select("SELECT saved_filename FROM image WHERE id = " + std::to_string(image_id) + ";")[0]["saved_filename"];
+    DbResult image = db_query("SELECT saved_filename FROM image WHERE id = ?", { int64_t(image_id) });
+    std::string file_path = image.rows.empty() ? "" : db_string(image.rows[0][0]);
 
-    if (!file_path.empty() && std::filesystem::exists(file_path)) {
-        std::ifstream file(file_path, std::ios::binary);
-        if (file) {
-            std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-            file.close();
+    // Variante ridimensionata più piccola che copra la larghezza richiesta
+    if (req.has_param("width") && !file_path.empty()) {
+        file_path = select_image_variant(file_path, std::stoi(req.get_param_value("width")));
+    }
 
+    if (!file_path.empty() && std::filesystem::exists(file_path)) {
+        std::string buffer;
+        if (io_read_whole_file(file_path, buffer)) {
             std::string mime_type = "image/" + file_path.substr(file_path.find_last_of('.') + 1);
 
             res.status = 200;
             res.set_header("Access-Control-Allow-Origin", "*");
             res.set_header("Content-Type", mime_type); 
-            res.set_content(buffer.data(), buffer.size(), mime_type);
+            res.set_content(std::move(buffer), mime_type);
             return 200;
         } else {
             std::cerr << "[ERROR] Failed to open file: " << file_path << std::endl;
@@ -1019,19 +1465,12 @@ int handle_get_user_info(const httplib::Request& req, httplib::Response& res)
                 std::to_string(time(nullptr)) +
                 file_ext;
 
-            // Salva nel database
-            std::string query = "INSERT INTO image (saved_filename) "
-                "VALUES ('" + saved_filename + "') ";
-
-            db_execute(query);
-            json db_result = db_select("SELECT id FROM image WHERE saved_filename = '" + saved_filename + "'")[0];
-            if (!db_result.is_null() && db_result.contains("id")) {
-                media_info["image_id"] = db_result["id"];
-                media_info["url"] = "/media/" + saved_filename;
+            // Salva nel database in differita: nessuno attende l'id
+            db_write_async({ { "image", { "saved_filename" }, { saved_filename }, "" } });
+            media_info["url"] = "/media/" + saved_filename;
 
-                // Copia il file nella cartella pubblica
-                std::filesystem::copy(local_path, "./public/media/" + saved_filename);
-            }
+            // Copia il file nella cartella pubblica
+            std::filesystem::copy(local_path, "./public/media/" + saved_filename);
         }
         // Altrimenti scarica da remoto
         else if (media_info["remote"].contains("id")) {
@@ -1061,17 +1500,10 @@ int handle_get_user_info(const httplib::Request& req, httplib::Response& res)
                             std::to_string(time(nullptr)) +
                             file_ext;
 
-                        // Salva nel database
-                        std::string query = "INSERT INTO images (saved_filename) "
-                            "VALUES ('" + saved_filename + "') ";
-
-                        db_execute(query);
-                        json db_result = db_select("SELECT id FROM image WHERE saved_filename = '" + saved_filename + "'")[0];
-                        if (!db_result.is_null() && db_result.contains("id")) {
-                            media_info["image_id"] = db_result["id"];
-                            media_info["url"] = "/media/" + saved_filename;
-                            std::filesystem::copy(local_path, "./public/media/" + saved_filename);
-                        }
+                        // Salva nel database in differita: nessuno attende l'id
+                        db_write_async({ { "image", { "saved_filename" }, { saved_filename }, "" } });
+                        media_info["url"] = "/media/" + saved_filename;
+                        std::filesystem::copy(local_path, "./public/media/" + saved_filename);
 
                         downloaded = true;
                         break;
@@ -1151,4 +1583,108 @@ int handle_get_user_info(const httplib::Request& req, httplib::Response& res)
     res.set_content(result.dump(), "application/json");
     res.status = 200;
     return 200;
-}
\ No newline at end of file
+}
+int handle_storyboard(const httplib::Request& req, httplib::Response& res)
+{
+    if (!req.has_param("session_id") || !req.has_param("file_id")) {
+        std::cerr << "[ERROR] Missing session_id or file_id parameter in request." << std::endl;
+        res.status = 400;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Missing session_id or file_id parameter\"}", "application/json");
+        return 400;
+    }
+
+    uint32_t session_id = std::stoul(req.get_param_value("session_id"));
+    unsigned int file_id = std::stoul(req.get_param_value("file_id"));
+
+    std::shared_ptr<ClientSession> session = getSession(session_id);
+    json file = get_td_file(session, file_id);
+
+    if (file.is_null()) {
+        res.status = 504;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"TDLib response timeout\"}", "application/json");
+        return 504;
+    }
+
+    std::string unique_id = file["remote"]["unique_id"];
+    bool complete = file["local"]["is_downloading_completed"];
+    std::string source_path = complete ? file["local"]["path"].get<std::string>() : "";
+
+    json index;
+    StoryboardState state = get_storyboard(unique_id, source_path, index);
+
+    if (state == StoryboardState::Ready) {
+        index["sheet_url"] = "/storyboard/sheet?id=" + unique_id + "&n=";
+
+        res.status = 200;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Cache-Control", "max-age=86400");
+        res.set_content(index.dump(), "application/json");
+        return 200;
+    }
+
+    if (state == StoryboardState::Failed) {
+        res.status = 422;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_content("{\"error\": \"Could not generate storyboard\"}", "application/json");
+        return 422;
+    }
+
+    // The whole source is needed: fetch it in the background unless playback is already downloading it
+    if (!complete && !file["local"]["is_downloading_active"].get<bool>()) {
+        session->send({
+            {"@type", "downloadFile"},
+            {"file_id", file_id},
+            {"priority", 1},
+            {"offset", 0},
+            {"limit", 0},
+            {"synchronous", false}
+            });
+    }
+
+    res.status = 202;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_header("Retry-After", "5");
+    res.set_content("{\"status\": \"pending\"}", "application/json");
+    return 202;
+}
+
+int handle_storyboard_sheet(const httplib::Request& req, httplib::Response& res)
+{
+    std::string unique_id = req.get_param_value("id");
+    int sheet = req.has_param("n") ? std::stoi(req.get_param_value("n")) : -1;
+
+    std::string path = get_storyboard_sheet_path(unique_id, sheet);
+    if (path.empty()) {
+        res.status = 404;
+        res.set_header("Access-Control-Allow-Origin", "*");
+        return 404;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    res.status = 200;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_header("Cache-Control", "max-age=86400");
+    res.set_content(std::move(data), "image/jpeg");
+    return 200;
+}
+
+int handle_metrics(const httplib::Request&, httplib::Response& res)
+{
+    json metrics = {
+        {"db_backend", db_backend_name()},
+        {"db_pool", db_pool_metrics()},
+        {"db_writer", db_writer_metrics()},
+        {"db_queries", db_query_metrics()},
+        {"io_engine", io_engine_name()},
+        {"metadata_cache", metadata_cache_metrics()}
+    };
+
+    res.status = 200;
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_content(metrics.dump(), "application/json");
+    return 200;
+}
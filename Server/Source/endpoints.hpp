@@ -4,18 +4,29 @@
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 
+// /videos_data streams rows into the response, sent as chunks of about this size
+inline constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
 extern void setup_endpoints_http();
 extern void setup_endpoints_https();
 extern int handle_video(const httplib::Request&, httplib::Response&);
+extern int handle_rendition(const httplib::Request&, httplib::Response&);
 extern int handle_image(const httplib::Request&, httplib::Response&);
 extern int handle_get_files(const httplib::Request&, httplib::Response&);
 extern int handle_auth(const httplib::Request&, httplib::Response&);
 extern int handle_get_state(const httplib::Request&, httplib::Response&);
 extern int handle_logout(const httplib::Request&, httplib::Response&);
 extern int handle_chats(const httplib::Request&, httplib::Response&);
-extern int handle_upload(const httplib::Request&, httplib::Response&);
+extern int handle_upload(const httplib::Request&, httplib::Response&, const httplib::ContentReader&);
+extern int handle_upload_expect(const httplib::Request&, httplib::Response&);
+extern int handle_upload_status(const httplib::Request&, httplib::Response&);
+extern int handle_upload_jobs(const httplib::Request&, httplib::Response&);
 extern int handle_get_user_info(const httplib::Request&, httplib::Response&);
+extern int handle_storyboard(const httplib::Request&, httplib::Response&);
+extern int handle_storyboard_sheet(const httplib::Request&, httplib::Response&);
 
 extern int get_videos_data_handler(const httplib::Request&, httplib::Response&); 
 extern int set_video_data_handler(const httplib::Request&, httplib::Response&);
+extern int handle_videos_data(const httplib::Request&, httplib::Response&);
+extern int handle_metrics(const httplib::Request&, httplib::Response&);
 
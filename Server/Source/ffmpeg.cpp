@@ -1,6 +1,8 @@
 #include "ffmpeg.hpp"
 #include "common.hpp"
 
+#include <cstring>
+
 VideoMetadata get_video_metadata(const std::string& path) {
     AVFormatContext* fmt_ctx = nullptr;
     VideoMetadata meta;
@@ -49,4 +51,95 @@ VideoMetadata get_video_metadata(const std::string& path) {
 
     avformat_close_input(&fmt_ctx);
     return meta;
-}
\ No newline at end of file
+}
+AVFrame* alloc_picture(int width, int height)
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    frame->color_range = AVCOL_RANGE_JPEG;
+
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    // Black background for partially filled pictures
+    memset(frame->data[0], 0, frame->linesize[0] * height);
+    memset(frame->data[1], 128, frame->linesize[1] * ((height + 1) / 2));
+    memset(frame->data[2], 128, frame->linesize[2] * ((height + 1) / 2));
+
+    return frame;
+}
+
+bool scale_frame_into(const AVFrame* src, AVFrame* dst, int x, int y, int width, int height)
+{
+    if (x % 2 || y % 2 || x + width > dst->width || y + height > dst->height) {
+        return false;
+    }
+
+    SwsContext* sws = sws_getContext(src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                     width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!sws) {
+        return false;
+    }
+
+    // JPEG output uses full range YUV
+    int* inv_table = nullptr;
+    int* table = nullptr;
+    int src_range = 0, dst_range = 0, brightness = 0, contrast = 0, saturation = 0;
+    if (sws_getColorspaceDetails(sws, &inv_table, &src_range, &table, &dst_range, &brightness, &contrast, &saturation) >= 0) {
+        sws_setColorspaceDetails(sws, inv_table, src_range, table, 1, brightness, contrast, saturation);
+    }
+
+    uint8_t* planes[4] = {
+        dst->data[0] + y * dst->linesize[0] + x,
+        dst->data[1] + (y / 2) * dst->linesize[1] + x / 2,
+        dst->data[2] + (y / 2) * dst->linesize[2] + x / 2,
+        nullptr
+    };
+
+    sws_scale(sws, src->data, src->linesize, 0, src->height, planes, dst->linesize);
+    sws_freeContext(sws);
+    return true;
+}
+
+bool encode_jpeg(const AVFrame* frame, std::string& out, int quality)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!codec) {
+        return false;
+    }
+
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    ctx->width = frame->width;
+    ctx->height = frame->height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->color_range = AVCOL_RANGE_JPEG;
+    ctx->time_base = { 1, 25 };
+    ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    ctx->global_quality = FF_QP2LAMBDA * quality;
+
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    AVFrame* input = av_frame_clone(frame);
+    input->quality = ctx->global_quality;
+    input->pict_type = AV_PICTURE_TYPE_I;
+    input->pts = 0;
+
+    AVPacket* pkt = av_packet_alloc();
+    bool ok = avcodec_send_frame(ctx, input) >= 0 && avcodec_send_frame(ctx, nullptr) >= 0 && avcodec_receive_packet(ctx, pkt) >= 0;
+
+    if (ok) {
+        out.assign(reinterpret_cast<const char*>(pkt->data), pkt->size);
+    }
+
+    av_packet_free(&pkt);
+    av_frame_free(&input);
+    avcodec_free_context(&ctx);
+    return ok;
+}
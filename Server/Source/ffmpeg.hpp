@@ -2,7 +2,9 @@
 
 extern "C" {
     #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
     #include <libavutil/avutil.h>
+    #include <libswscale/swscale.h>
 }
 
 #include <string>
@@ -14,4 +16,9 @@ struct VideoMetadata {
     bool valid = false;
 };
 
-extern VideoMetadata get_video_metadata(const std::string& path);
\ No newline at end of file
+extern VideoMetadata get_video_metadata(const std::string& path);
+
+// Picture helpers shared by storyboards and thumbnails (YUV420P, full range)
+extern AVFrame* alloc_picture(int width, int height);
+extern bool scale_frame_into(const AVFrame* src, AVFrame* dst, int x, int y, int width, int height);
+extern bool encode_jpeg(const AVFrame* frame, std::string& out, int quality = 5);
\ No newline at end of file
@@ -0,0 +1,791 @@
+#include "io_engine.hpp"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define IO_ENGINE_URING
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+    #include <sys/mman.h>
+    #include <sys/uio.h>
+#endif
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+
+static bool pread_all(int fd, uint64_t offset, char* data, size_t length)
+{
+    while(length > 0){
+        ssize_t read = pread(fd, data, length, static_cast<off_t>(offset));
+        if(read < 0 && errno == EINTR){
+            continue;
+        }
+        if(read <= 0){
+            return false;
+        }
+
+        data += read;
+        offset += read;
+        length -= read;
+    }
+
+    return true;
+}
+
+static bool pwrite_all(int fd, uint64_t offset, const char* data, size_t length)
+{
+    while(length > 0){
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if(written < 0){
+            if(errno == EINTR) continue;
+            return false;
+        }
+
+        data += written;
+        offset += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+#endif
+
+#ifdef IO_ENGINE_URING
+
+struct Ring {
+    int fd = -1;
+    unsigned int entries = 0;
+
+    unsigned int* sq_head = nullptr;
+    unsigned int* sq_tail = nullptr;
+    unsigned int* sq_mask = nullptr;
+    unsigned int* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+
+    unsigned int* cq_head = nullptr;
+    unsigned int* cq_tail = nullptr;
+    unsigned int* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void* sq_ptr = nullptr;
+    size_t sq_size = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_size = 0;
+    size_t sqes_size = 0;
+};
+
+// One submitted operation; the completion thread fills `result` and sets `done`.
+struct IoPiece {
+    uint8_t opcode = IORING_OP_NOP;
+    int fd = -1;
+    int slot = -1; // fixed file index, -1 to use `fd`
+    uint64_t offset = 0;
+    char* data = nullptr;
+    unsigned int length = 0;
+    int buffer = -1; // registered buffer index
+    int result = 0;
+    bool done = false;
+};
+
+// A file kept open (and registered in the fixed file table) while it is being read
+struct HotFile {
+    std::string path;
+    int fd = -1;
+    int slot = -1;
+    dev_t device = 0;
+    ino_t inode = 0;
+
+    ~HotFile();
+};
+
+static Ring ring;
+static std::atomic<bool> uring_active = false; // written under users_mutex
+static std::thread completion_thread;
+
+// Callers inside the ring; stop_io_engine waits for them before tearing it down
+static std::mutex users_mutex;
+static std::condition_variable users_cv;
+static unsigned int ring_users = 0;
+
+// Guards the submission queue, `in_flight` and `unsubmitted`
+static std::mutex submit_mutex;
+static std::condition_variable submit_cv;
+static unsigned int in_flight = 0;
+static unsigned int unsubmitted = 0;
+
+static std::mutex completion_mutex;
+static std::condition_variable completion_cv;
+
+static std::mutex buffers_mutex;
+static std::vector<char*> fixed_buffers;
+static std::vector<int> free_buffers;
+
+static std::mutex hot_files_mutex;
+static std::list<std::shared_ptr<HotFile>> hot_files; // most recently used first
+static std::vector<int> free_slots;
+
+static int io_uring_setup(unsigned int entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned int opcode, const void* arg, unsigned int count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static bool map_ring(const io_uring_params& params)
+{
+    ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        ring.sq_size = ring.cq_size = std::max(ring.sq_size, ring.cq_size);
+    }
+
+    ring.sq_ptr = mmap(nullptr, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if(ring.sq_ptr == MAP_FAILED){
+        ring.sq_ptr = nullptr;
+        return false;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        ring.cq_ptr = ring.sq_ptr;
+    }else{
+        ring.cq_ptr = mmap(nullptr, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if(ring.cq_ptr == MAP_FAILED){
+            ring.cq_ptr = nullptr;
+            return false;
+        }
+    }
+
+    ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED){
+        return false;
+    }
+
+    char* sq = static_cast<char*>(ring.sq_ptr);
+    char* cq = static_cast<char*>(ring.cq_ptr);
+
+    ring.sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    ring.sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    ring.sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    ring.sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    ring.cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    ring.cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    ring.cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    ring.entries = params.sq_entries;
+    return true;
+}
+
+static void unmap_ring()
+{
+    if(ring.sqes){
+        munmap(ring.sqes, ring.sqes_size);
+    }
+    if(ring.cq_ptr && ring.cq_ptr != ring.sq_ptr){
+        munmap(ring.cq_ptr, ring.cq_size);
+    }
+    if(ring.sq_ptr){
+        munmap(ring.sq_ptr, ring.sq_size);
+    }
+    if(ring.fd >= 0){
+        close(ring.fd);
+    }
+
+    ring = Ring();
+}
+
+// Registration can fail (RLIMIT_MEMLOCK, old kernels): the ring then works without these extras.
+static void register_buffers()
+{
+    std::vector<iovec> iovecs;
+
+    for(unsigned int i = 0; i < IO_FIXED_BUFFERS; i++){
+        void* memory = nullptr;
+        if(posix_memalign(&memory, 4096, IO_PIECE_SIZE) != 0){
+            break;
+        }
+        fixed_buffers.push_back(static_cast<char*>(memory));
+        iovecs.push_back({ memory, IO_PIECE_SIZE });
+    }
+
+    if(iovecs.empty() || io_uring_register(ring.fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) < 0){
+        for(char* buffer : fixed_buffers){
+            free(buffer);
+        }
+        fixed_buffers.clear();
+        return;
+    }
+
+    for(int i = 0; i < static_cast<int>(fixed_buffers.size()); i++){
+        free_buffers.push_back(i);
+    }
+}
+
+static void register_files()
+{
+    std::vector<int> sparse(IO_HOT_FILES, -1);
+    if(io_uring_register(ring.fd, IORING_REGISTER_FILES, sparse.data(), sparse.size()) < 0){
+        return;
+    }
+
+    for(int i = 0; i < static_cast<int>(IO_HOT_FILES); i++){
+        free_slots.push_back(i);
+    }
+}
+
+static void update_slot(int slot, int fd)
+{
+    io_uring_files_update update = {};
+    update.offset = slot;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    io_uring_register(ring.fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+}
+
+HotFile::~HotFile()
+{
+    if(slot >= 0){
+        std::lock_guard<std::mutex> lock(hot_files_mutex);
+        update_slot(slot, -1);
+        free_slots.push_back(slot);
+    }
+    if(fd >= 0){
+        close(fd);
+    }
+}
+
+// Returns an open descriptor for `path`, reusing the one from a recent read if the file is the same
+static std::shared_ptr<HotFile> acquire_hot_file(const std::string& path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0){
+        return nullptr;
+    }
+
+    // Dropped entries are released after the lock: the last owner closes the descriptor
+    std::vector<std::shared_ptr<HotFile>> evicted;
+    std::lock_guard<std::mutex> lock(hot_files_mutex);
+
+    for(auto it = hot_files.begin(); it != hot_files.end(); it++){
+        if((*it)->path != path){
+            continue;
+        }
+
+        // Replaced on disk (e.g. TDLib deleted and downloaded it again): drop the stale descriptor
+        if((*it)->device != st.st_dev || (*it)->inode != st.st_ino){
+            evicted.push_back(*it);
+            hot_files.erase(it);
+            break;
+        }
+
+        hot_files.splice(hot_files.begin(), hot_files, it);
+        return hot_files.front();
+    }
+
+    auto file = std::make_shared<HotFile>();
+    file->path = path;
+    file->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    if(file->fd < 0){
+        return nullptr;
+    }
+
+    if(hot_files.size() >= IO_HOT_FILES){
+        // Readers still holding the oldest entry keep it alive, and its slot, until they finish
+        evicted.push_back(hot_files.back());
+        hot_files.pop_back();
+    }
+
+    if(!free_slots.empty()){
+        file->slot = free_slots.back();
+        free_slots.pop_back();
+        update_slot(file->slot, file->fd);
+    }
+
+    hot_files.push_front(file);
+    return file;
+}
+
+// Takes a reference on the ring; false once it is stopped, the caller then uses pread/pwrite
+static bool enter_ring()
+{
+    std::lock_guard<std::mutex> lock(users_mutex);
+    if(!uring_active){
+        return false;
+    }
+
+    ring_users++;
+    return true;
+}
+
+static void leave_ring()
+{
+    std::lock_guard<std::mutex> lock(users_mutex);
+    if(--ring_users == 0){
+        users_cv.notify_all();
+    }
+}
+
+// Index of the registered buffer holding [data, data + length), -1 for caller memory
+static int registered_buffer(const char* data, size_t length)
+{
+    for(size_t i = 0; i < fixed_buffers.size(); i++){
+        if(data >= fixed_buffers[i] && data + length <= fixed_buffers[i] + IO_PIECE_SIZE){
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+static int acquire_buffer()
+{
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    if(free_buffers.empty()){
+        return -1;
+    }
+
+    int buffer = free_buffers.back();
+    free_buffers.pop_back();
+    return buffer;
+}
+
+static void release_buffer(int buffer)
+{
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    free_buffers.push_back(buffer);
+}
+
+// Caller must hold submit_mutex
+static void enter_pending()
+{
+    while(unsubmitted > 0){
+        int submitted = io_uring_enter(ring.fd, unsubmitted, 0, 0);
+        if(submitted < 0){
+            if(errno == EINTR) continue;
+            // EAGAIN/EBUSY: the completion thread submits them again after reaping
+            return;
+        }
+        unsubmitted -= submitted;
+    }
+}
+
+// Queues all pieces with a single io_uring_enter and waits for their completions.
+static void submit_and_wait(std::vector<IoPiece>& pieces)
+{
+    {
+        std::unique_lock<std::mutex> lock(submit_mutex);
+        submit_cv.wait(lock, [&] { return in_flight + pieces.size() <= ring.entries; });
+
+        unsigned int tail = *ring.sq_tail;
+        for(IoPiece& piece : pieces){
+            unsigned int index = tail & *ring.sq_mask;
+            io_uring_sqe* sqe = &ring.sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+
+            sqe->opcode = piece.opcode;
+            sqe->fd = piece.slot >= 0 ? piece.slot : piece.fd;
+            sqe->flags = piece.slot >= 0 ? IOSQE_FIXED_FILE : 0;
+            sqe->off = piece.offset;
+            sqe->addr = reinterpret_cast<uint64_t>(piece.data);
+            sqe->len = piece.length;
+            sqe->buf_index = piece.buffer >= 0 ? piece.buffer : 0;
+            sqe->user_data = reinterpret_cast<uint64_t>(&piece);
+
+            ring.sq_array[index] = index;
+            tail++;
+        }
+
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        in_flight += pieces.size();
+        unsubmitted += pieces.size();
+        enter_pending();
+    }
+
+    std::unique_lock<std::mutex> lock(completion_mutex);
+    completion_cv.wait(lock, [&] {
+        return std::all_of(pieces.begin(), pieces.end(), [](const IoPiece& piece) { return piece.done; });
+    });
+}
+
+static void completion_loop()
+{
+    while(true){
+        if(io_uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            std::cerr << "[ERROR] io_uring_enter failed: " << strerror(errno) << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        unsigned int reaped = 0;
+        bool stop = false;
+
+        {
+            std::lock_guard<std::mutex> lock(completion_mutex);
+            unsigned int head = *ring.cq_head;
+            unsigned int tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+            for(; head != tail; head++, reaped++){
+                const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+                IoPiece* piece = reinterpret_cast<IoPiece*>(cqe.user_data);
+
+                if(piece){
+                    piece->result = cqe.res;
+                    piece->done = true;
+                }else{
+                    stop = true; // NOP posted by stop_io_engine
+                }
+            }
+
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        if(reaped > 0){
+            std::lock_guard<std::mutex> lock(submit_mutex);
+            in_flight -= reaped;
+            enter_pending();
+        }
+
+        completion_cv.notify_all();
+        submit_cv.notify_all();
+
+        if(stop){
+            return;
+        }
+    }
+}
+
+// Runs `length` bytes of reads or writes as batches of pieces; short transfers are resumed.
+static bool uring_transfer(uint8_t opcode, int fd, int slot, uint64_t offset, char* data, size_t length)
+{
+    bool reading = opcode == IORING_OP_READ;
+    size_t max_batch = std::max<size_t>(1, ring.entries / 4);
+
+    while(length > 0){
+        std::vector<IoPiece> pieces;
+
+        for(size_t queued = 0; queued < length && pieces.size() < max_batch; ){
+            IoPiece piece;
+            piece.opcode = opcode;
+            piece.fd = fd;
+            piece.slot = slot;
+            piece.offset = offset + queued;
+            piece.data = data + queued;
+            piece.length = static_cast<unsigned int>(std::min(IO_PIECE_SIZE, length - queued));
+
+            // Reads land straight in the caller's memory; READ_FIXED only when that is a registered buffer
+            if(reading){
+                piece.buffer = registered_buffer(piece.data, piece.length);
+                if(piece.buffer >= 0){
+                    piece.opcode = IORING_OP_READ_FIXED;
+                }
+            }
+
+            queued += piece.length;
+            pieces.push_back(piece);
+        }
+
+        submit_and_wait(pieces);
+
+        // Everything up to the first short or failed piece counts; the rest is submitted again
+        size_t done = 0;
+        bool short_transfer = false;
+        int error = 0;
+
+        for(IoPiece& piece : pieces){
+            if(!short_transfer){
+                if(piece.result < 0){
+                    error = -piece.result;
+                    short_transfer = true;
+                }else{
+                    done += piece.result;
+                    short_transfer = static_cast<unsigned int>(piece.result) < piece.length;
+                }
+            }
+        }
+
+        if(error != 0 && error != EINTR && error != EAGAIN){
+            errno = error;
+            return false;
+        }
+
+        if(done == 0 && error == 0){
+            return false; // end of file
+        }
+
+        offset += done;
+        data += done;
+        length -= done;
+    }
+
+    return true;
+}
+
+void start_io_engine()
+{
+    if(uring_active){
+        return;
+    }
+
+    io_uring_params params = {};
+    ring.fd = io_uring_setup(IO_RING_ENTRIES, &params);
+    if(ring.fd < 0){
+        std::cerr << "[ERROR] io_uring unavailable (" << strerror(errno) << "), using pread/pwrite" << std::endl;
+        ring.fd = -1;
+        return;
+    }
+
+    // IORING_OP_READ/WRITE came after the first io_uring kernels; fast poll is as recent as them
+    if(!(params.features & IORING_FEAT_FAST_POLL)){
+        std::cerr << "[ERROR] io_uring too old, using pread/pwrite" << std::endl;
+        close(ring.fd);
+        ring.fd = -1;
+        return;
+    }
+
+    if(!map_ring(params)){
+        std::cerr << "[ERROR] Failed to map io_uring, using pread/pwrite" << std::endl;
+        unmap_ring();
+        return;
+    }
+
+    register_buffers();
+    register_files();
+
+    completion_thread = std::thread(completion_loop);
+    {
+        std::lock_guard<std::mutex> lock(users_mutex);
+        uring_active = true;
+    }
+
+    std::cout << "io_uring ready: " << ring.entries << " entries, " << fixed_buffers.size() << " registered buffers, "
+              << free_slots.size() << " fixed file slots" << std::endl;
+}
+
+void stop_io_engine()
+{
+    // HTTP threads may still be serving: from here on they use pread/pwrite, and the ring is only
+    // torn down once the requests already inside it have finished
+    {
+        std::unique_lock<std::mutex> lock(users_mutex);
+        if(!uring_active){
+            return;
+        }
+
+        uring_active = false;
+        users_cv.wait(lock, [] { return ring_users == 0; });
+    }
+
+    // The NOP only wakes the completion thread, nothing else is in flight
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        unsigned int tail = *ring.sq_tail;
+        unsigned int index = tail & *ring.sq_mask;
+        memset(&ring.sqes[index], 0, sizeof(io_uring_sqe));
+        ring.sqes[index].opcode = IORING_OP_NOP;
+        ring.sqes[index].user_data = 0;
+        ring.sq_array[index] = index;
+        __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        enter_pending();
+    }
+
+    completion_thread.join();
+
+    std::list<std::shared_ptr<HotFile>> closing;
+    {
+        std::lock_guard<std::mutex> lock(hot_files_mutex);
+        closing.swap(hot_files);
+    }
+    closing.clear();
+
+    unmap_ring();
+
+    for(char* buffer : fixed_buffers){
+        free(buffer);
+    }
+    fixed_buffers.clear();
+    free_buffers.clear();
+    free_slots.clear();
+}
+
+const char* io_engine_name()
+{
+    return uring_active ? "io_uring" : "pread";
+}
+
+IoBuffer::IoBuffer()
+{
+    // The ring reference keeps the registered memory alive until the buffer is released
+    if(enter_ring()){
+        index = acquire_buffer();
+        if(index >= 0){
+            memory = fixed_buffers[index];
+            return;
+        }
+        leave_ring();
+    }
+
+    memory = static_cast<char*>(malloc(IO_PIECE_SIZE));
+}
+
+IoBuffer::~IoBuffer()
+{
+    if(index < 0){
+        free(memory);
+        return;
+    }
+
+    release_buffer(index);
+    leave_ring();
+}
+
+bool io_read_file(const std::string& path, uint64_t offset, char* data, size_t length)
+{
+    if(!enter_ring()){
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
+            return false;
+        }
+
+        bool ok = pread_all(fd, offset, data, length);
+        close(fd);
+        return ok;
+    }
+
+    bool ok;
+    {
+        std::shared_ptr<HotFile> file = acquire_hot_file(path);
+        ok = file && uring_transfer(IORING_OP_READ, file->fd, file->slot, offset, data, length);
+    }
+
+    leave_ring();
+    return ok;
+}
+
+bool io_pread(int fd, uint64_t offset, char* data, size_t length)
+{
+    if(!enter_ring()){
+        return pread_all(fd, offset, data, length);
+    }
+
+    bool ok = uring_transfer(IORING_OP_READ, fd, -1, offset, data, length);
+    leave_ring();
+    return ok;
+}
+
+bool io_pwrite(int fd, uint64_t offset, const char* data, size_t length)
+{
+    // A write of one piece has nothing to batch and no registered buffer to use: through the ring
+    // it only adds the hand-off to the completion thread (upload chunk bodies arrive 16 KB at a time)
+    if(length <= IO_PIECE_SIZE || !enter_ring()){
+        return pwrite_all(fd, offset, data, length);
+    }
+
+    bool ok = uring_transfer(IORING_OP_WRITE, fd, -1, offset, const_cast<char*>(data), length);
+    leave_ring();
+    return ok;
+}
+
+#else
+
+IoBuffer::IoBuffer() : memory(static_cast<char*>(malloc(IO_PIECE_SIZE)))
+{
+}
+
+IoBuffer::~IoBuffer()
+{
+    free(memory);
+}
+
+void start_io_engine()
+{
+}
+
+void stop_io_engine()
+{
+}
+
+const char* io_engine_name()
+{
+    return "pread";
+}
+
+#ifdef _WIN32
+
+bool io_read_file(const std::string& path, uint64_t offset, char* data, size_t length)
+{
+    std::ifstream file(std::filesystem::u8path(path), std::ios::binary);
+    file.seekg(offset);
+    file.read(data, length);
+    return static_cast<size_t>(file.gcount()) == length;
+}
+
+#else
+
+bool io_read_file(const std::string& path, uint64_t offset, char* data, size_t length)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+
+    bool ok = pread_all(fd, offset, data, length);
+    close(fd);
+    return ok;
+}
+
+bool io_pread(int fd, uint64_t offset, char* data, size_t length)
+{
+    return pread_all(fd, offset, data, length);
+}
+
+bool io_pwrite(int fd, uint64_t offset, const char* data, size_t length)
+{
+    return pwrite_all(fd, offset, data, length);
+}
+
+#endif
+
+#endif
+
+bool io_read_whole_file(const std::string& path, std::string& data)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+    if(ec){
+        return false;
+    }
+
+    data.resize(static_cast<size_t>(size));
+    return size == 0 || io_read_file(path, 0, data.data(), data.size());
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Positional file I/O for the request paths (range reads, upload chunk writes).
+// On Linux requests go through a shared io_uring: a large request is split into pieces submitted
+// as one batch, reads into an IoBuffer use the registered buffers and recently read files stay
+// open in the ring's fixed file table. Without io_uring (other systems, old kernels, seccomp) the same calls
+// fall back to pread/pwrite.
+inline constexpr unsigned int IO_RING_ENTRIES = 256;
+inline constexpr size_t IO_PIECE_SIZE = 256 * 1024;
+inline constexpr unsigned int IO_FIXED_BUFFERS = 32;
+inline constexpr unsigned int IO_HOT_FILES = 64;
+
+// Scratch buffer of IO_PIECE_SIZE bytes for reads whose data is consumed in place (e.g. hashing).
+// With io_uring it is one of the registered buffers, so reads into it skip pinning the pages on
+// every request; otherwise, or when all of them are taken, plain heap memory.
+class IoBuffer{
+public:
+    IoBuffer();
+    ~IoBuffer();
+
+    IoBuffer(const IoBuffer&) = delete;
+    IoBuffer& operator=(const IoBuffer&) = delete;
+
+    char* data() const { return memory; }
+    size_t size() const { return IO_PIECE_SIZE; }
+
+private:
+    char* memory = nullptr;
+    int index = -1; // registered buffer, -1 for heap memory
+};
+
+extern void start_io_engine();
+extern void stop_io_engine();
+extern const char* io_engine_name();
+
+// Reads exactly [offset, offset + length) of `path`; false if the file is shorter or unreadable
+extern bool io_read_file(const std::string& path, uint64_t offset, char* data, size_t length);
+extern bool io_read_whole_file(const std::string& path, std::string& data);
+
+#ifndef _WIN32
+extern bool io_pread(int fd, uint64_t offset, char* data, size_t length);
+extern bool io_pwrite(int fd, uint64_t offset, const char* data, size_t length);
+#endif
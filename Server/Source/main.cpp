@@ -9,6 +9,13 @@
 #include "app_data.hpp"
 #include "endpoints.hpp"
 #include "db.hpp"
+#include "migrations.hpp"
+#include "db_writer.hpp"
+#include "transcode.hpp"
+#include "storyboard.hpp"
+#include "upload.hpp"
+#include "upload_jobs.hpp"
+#include "io_engine.hpp"
 
 std::atomic<bool> running(true);
 
@@ -16,7 +23,6 @@ void signal_handler(int signal)
 {
     if(signal == SIGINT){
         std::cout << "\n🛑 Interruzione ricevuta (Ctrl + C). Arresto del server...\n";
-        disconnect_db();
         running = false;
     }
 }
@@ -25,7 +31,17 @@ int main()
 {
     std::signal(SIGINT, signal_handler);
 
-    connect_db();
+    if(connect_db() == 0 && run_migrations() != 0){
+        std::cerr << "[ERROR] Database migrations failed, stopping the server" << std::endl;
+        disconnect_db();
+        return 1;
+    }
+    start_db_writer();
+    start_io_engine();
+    start_transcode_pool();
+    start_storyboards();
+    start_upload_registry();
+    start_upload_jobs();
     std::thread https_thread(setup_endpoints_https);
     std::thread http_thread(setup_endpoints_http);
 
@@ -33,6 +49,16 @@ int main()
         std::this_thread::sleep_for(std::chrono::seconds(5));
     }
 
+    stop_upload_jobs();
+    stop_upload_registry();
+    stop_storyboards();
+    stop_transcode_pool();
+    stop_io_engine();
+
+    // Last: the upload workers may still queue writes while stopping
+    stop_db_writer();
+    disconnect_db();
+
     std::cout << "✅ Server arrestato correttamente.\n";
     return 0;
 }
\ No newline at end of file
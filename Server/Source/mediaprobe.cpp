@@ -0,0 +1,362 @@
+#include "mediaprobe.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+// Headers larger than this are not worth parsing by hand
+static constexpr uint64_t MAX_HEADER_SIZE = 64 * 1024 * 1024;
+
+static uint32_t read_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static uint64_t read_be64(const uint8_t* p)
+{
+    return (uint64_t(read_be32(p)) << 32) | read_be32(p + 4);
+}
+
+static uint64_t read_uint(const uint8_t* p, size_t length)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < length && i < 8; i++){
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// ---- MP4 ----
+
+// Calls `callback(type, payload, payload_size)` for each box in [data, data + size)
+template<typename Callback>
+static void for_each_box(const uint8_t* data, size_t size, Callback callback)
+{
+    size_t offset = 0;
+
+    while(offset + 8 <= size){
+        uint64_t box_size = read_be32(data + offset);
+        size_t header = 8;
+
+        if(box_size == 1){
+            if(offset + 16 > size) return;
+            box_size = read_be64(data + offset + 8);
+            header = 16;
+        }else if(box_size == 0){
+            box_size = size - offset;
+        }
+
+        if(box_size < header || box_size > size - offset){
+            return;
+        }
+
+        callback(std::string(reinterpret_cast<const char*>(data + offset + 4), 4), data + offset + header, static_cast<size_t>(box_size - header));
+        offset += static_cast<size_t>(box_size);
+    }
+}
+
+static bool parse_moov(const uint8_t* data, size_t size, VideoMetadata& meta)
+{
+    uint32_t timescale = 0;
+    uint64_t duration = 0;
+    bool found_video = false;
+
+    for_each_box(data, size, [&](const std::string& type, const uint8_t* p, size_t length) {
+        if(type == "mvhd" && length >= 32){
+            if(p[0] == 1){
+                timescale = read_be32(p + 20);
+                duration = read_be64(p + 24);
+            }else{
+                timescale = read_be32(p + 12);
+                duration = read_be32(p + 16);
+            }
+        }else if(type == "trak" && !found_video){
+            bool is_video = false;
+            uint32_t width = 0, height = 0;
+
+            for_each_box(p, length, [&](const std::string& child, const uint8_t* c, size_t child_length) {
+                if(child == "tkhd" && child_length >= 84){
+                    size_t dims = c[0] == 1 ? 88 : 76;
+                    if(child_length >= dims + 8){
+                        width = read_be32(c + dims) >> 16; // 16.16 fixed point
+                        height = read_be32(c + dims + 4) >> 16;
+                    }
+                }else if(child == "mdia"){
+                    for_each_box(c, child_length, [&](const std::string& mdia_child, const uint8_t* h, size_t h_length) {
+                        if(mdia_child == "hdlr" && h_length >= 12 && memcmp(h + 8, "vide", 4) == 0){
+                            is_video = true;
+                        }
+                    });
+                }
+            });
+
+            if(is_video && width > 0 && height > 0){
+                meta.width = static_cast<int>(width);
+                meta.height = static_cast<int>(height);
+                found_video = true;
+            }
+        }
+    });
+
+    if(!found_video || timescale == 0){
+        return false;
+    }
+
+    meta.duration = static_cast<int>(duration / timescale);
+    meta.valid = true;
+    return true;
+}
+
+static ProbeStatus probe_mp4(const ProbeReader& read, uint64_t file_size, VideoMetadata& meta)
+{
+    std::vector<uint8_t> buffer;
+    uint64_t offset = 0;
+
+    // moov may come before or after mdat: walk the top-level boxes until it shows up
+    while(offset + 8 <= file_size){
+        if(!read(offset, 8, buffer)){
+            return ProbeStatus::NeedMoreData;
+        }
+
+        uint64_t box_size = read_be32(buffer.data());
+        std::string type(reinterpret_cast<const char*>(buffer.data() + 4), 4);
+        uint64_t header = 8;
+
+        if(box_size == 1){
+            if(!read(offset, 16, buffer)){
+                return ProbeStatus::NeedMoreData;
+            }
+            box_size = read_be64(buffer.data() + 8);
+            header = 16;
+        }else if(box_size == 0){
+            box_size = file_size - offset;
+        }
+
+        if(box_size < header || box_size > file_size - offset){
+            return ProbeStatus::Unsupported;
+        }
+
+        if(type == "moov"){
+            if(box_size > MAX_HEADER_SIZE){
+                return ProbeStatus::Unsupported;
+            }
+
+            if(!read(offset + header, static_cast<size_t>(box_size - header), buffer)){
+                return ProbeStatus::NeedMoreData;
+            }
+
+            return parse_moov(buffer.data(), buffer.size(), meta) ? ProbeStatus::Found : ProbeStatus::Unsupported;
+        }
+
+        offset += box_size;
+    }
+
+    return ProbeStatus::Unsupported;
+}
+
+// ---- Matroska / WebM ----
+
+static constexpr uint32_t EBML_ID_HEADER = 0x1A45DFA3;
+static constexpr uint32_t MKV_ID_SEGMENT = 0x18538067;
+static constexpr uint32_t MKV_ID_INFO = 0x1549A966;
+static constexpr uint32_t MKV_ID_TIMECODE_SCALE = 0x2AD7B1;
+static constexpr uint32_t MKV_ID_DURATION = 0x4489;
+static constexpr uint32_t MKV_ID_TRACKS = 0x1654AE6B;
+static constexpr uint32_t MKV_ID_TRACK_ENTRY = 0xAE;
+static constexpr uint32_t MKV_ID_TRACK_TYPE = 0x83;
+static constexpr uint32_t MKV_ID_VIDEO = 0xE0;
+static constexpr uint32_t MKV_ID_PIXEL_WIDTH = 0xB0;
+static constexpr uint32_t MKV_ID_PIXEL_HEIGHT = 0xBA;
+static constexpr uint32_t MKV_ID_CLUSTER = 0x1F43B675;
+
+// Reads an EBML variable length integer. IDs keep their length marker, sizes do not.
+static bool read_vint(const uint8_t* p, size_t available, size_t& length, uint64_t& value, bool keep_marker)
+{
+    if(available == 0 || p[0] == 0){
+        return false;
+    }
+
+    length = 1;
+    while(!(p[0] & (0x80 >> (length - 1)))){
+        length++;
+    }
+
+    if(length > 8 || length > available){
+        return false;
+    }
+
+    value = keep_marker ? p[0] : (p[0] & (0xFF >> length));
+    for(size_t i = 1; i < length; i++){
+        value = (value << 8) | p[i];
+    }
+
+    return true;
+}
+
+struct EbmlElement {
+    uint32_t id = 0;
+    uint64_t size = 0;
+    size_t header = 0;
+    bool unknown_size = false;
+};
+
+static bool read_element(const uint8_t* p, size_t available, EbmlElement& element)
+{
+    size_t id_length, size_length;
+    uint64_t id;
+
+    if(!read_vint(p, available, id_length, id, true) || !read_vint(p + id_length, available - id_length, size_length, element.size, false)){
+        return false;
+    }
+
+    element.id = static_cast<uint32_t>(id);
+    element.header = id_length + size_length;
+    element.unknown_size = element.size == (1ULL << (7 * size_length)) - 1;
+    return true;
+}
+
+template<typename Callback>
+static void for_each_element(const uint8_t* data, size_t size, Callback callback)
+{
+    size_t offset = 0;
+    EbmlElement element;
+
+    while(offset < size && read_element(data + offset, size - offset, element)){
+        if(element.unknown_size || element.size > size - offset - element.header){
+            return;
+        }
+
+        callback(element.id, data + offset + element.header, static_cast<size_t>(element.size));
+        offset += element.header + static_cast<size_t>(element.size);
+    }
+}
+
+static ProbeStatus probe_mkv(const ProbeReader& read, uint64_t file_size, VideoMetadata& meta)
+{
+    std::vector<uint8_t> buffer;
+    EbmlElement element;
+
+    auto read_header = [&](uint64_t offset) -> ProbeStatus {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(12, file_size - offset));
+        if(!read(offset, length, buffer)){
+            return ProbeStatus::NeedMoreData;
+        }
+        return read_element(buffer.data(), buffer.size(), element) ? ProbeStatus::Found : ProbeStatus::Unsupported;
+    };
+
+    ProbeStatus status = read_header(0);
+    if(status != ProbeStatus::Found || element.id != EBML_ID_HEADER || element.unknown_size){
+        return status == ProbeStatus::Found ? ProbeStatus::Unsupported : status;
+    }
+
+    uint64_t offset = element.header + element.size;
+    if(offset >= file_size || (status = read_header(offset)) != ProbeStatus::Found){
+        return offset >= file_size ? ProbeStatus::Unsupported : status;
+    }
+
+    if(element.id != MKV_ID_SEGMENT){
+        return ProbeStatus::Unsupported;
+    }
+
+    uint64_t segment_end = element.unknown_size ? file_size : std::min(file_size, offset + element.header + element.size);
+    offset += element.header;
+
+    uint64_t timecode_scale = 1000000;
+    double duration = 0;
+    bool have_info = false, have_tracks = false;
+
+    while(offset < segment_end && !(have_info && have_tracks)){
+        if((status = read_header(offset)) != ProbeStatus::Found){
+            return status;
+        }
+
+        // Clusters follow the headers; reaching one means they are not where we can use them
+        if(element.id == MKV_ID_CLUSTER || element.unknown_size){
+            break;
+        }
+
+        uint64_t body = offset + element.header;
+
+        if(element.id == MKV_ID_INFO || element.id == MKV_ID_TRACKS){
+            if(element.size > MAX_HEADER_SIZE){
+                return ProbeStatus::Unsupported;
+            }
+
+            if(!read(body, static_cast<size_t>(element.size), buffer)){
+                return ProbeStatus::NeedMoreData;
+            }
+
+            if(element.id == MKV_ID_INFO){
+                have_info = true;
+                for_each_element(buffer.data(), buffer.size(), [&](uint32_t id, const uint8_t* p, size_t length) {
+                    if(id == MKV_ID_TIMECODE_SCALE){
+                        timecode_scale = read_uint(p, length);
+                    }else if(id == MKV_ID_DURATION && length == 4){
+                        uint32_t bits = read_be32(p);
+                        float value;
+                        memcpy(&value, &bits, sizeof(value));
+                        duration = value;
+                    }else if(id == MKV_ID_DURATION && length == 8){
+                        uint64_t bits = read_be64(p);
+                        memcpy(&duration, &bits, sizeof(duration));
+                    }
+                });
+            }else{
+                have_tracks = true;
+                for_each_element(buffer.data(), buffer.size(), [&](uint32_t id, const uint8_t* p, size_t length) {
+                    if(id != MKV_ID_TRACK_ENTRY || meta.width > 0) return;
+
+                    uint64_t track_type = 0, width = 0, height = 0;
+                    for_each_element(p, length, [&](uint32_t child, const uint8_t* c, size_t child_length) {
+                        if(child == MKV_ID_TRACK_TYPE){
+                            track_type = read_uint(c, child_length);
+                        }else if(child == MKV_ID_VIDEO){
+                            for_each_element(c, child_length, [&](uint32_t video_child, const uint8_t* v, size_t v_length) {
+                                if(video_child == MKV_ID_PIXEL_WIDTH) width = read_uint(v, v_length);
+                                if(video_child == MKV_ID_PIXEL_HEIGHT) height = read_uint(v, v_length);
+                            });
+                        }
+                    });
+
+                    if(track_type == 1 && width > 0 && height > 0){
+                        meta.width = static_cast<int>(width);
+                        meta.height = static_cast<int>(height);
+                    }
+                });
+            }
+        }
+
+        offset = body + element.size;
+    }
+
+    if(meta.width <= 0 || meta.height <= 0){
+        return ProbeStatus::Unsupported;
+    }
+
+    meta.duration = static_cast<int>(duration * static_cast<double>(timecode_scale) / 1e9);
+    meta.valid = true;
+    return ProbeStatus::Found;
+}
+
+ProbeStatus probe_header(const ProbeReader& read, uint64_t file_size, VideoMetadata& meta)
+{
+    std::vector<uint8_t> magic;
+    if(file_size < 12){
+        return ProbeStatus::Unsupported;
+    }
+
+    if(!read(0, 12, magic)){
+        return ProbeStatus::NeedMoreData;
+    }
+
+    meta = VideoMetadata();
+
+    if(memcmp(magic.data() + 4, "ftyp", 4) == 0){
+        return probe_mp4(read, file_size, meta);
+    }
+
+    if(read_be32(magic.data()) == EBML_ID_HEADER){
+        return probe_mkv(read, file_size, meta);
+    }
+
+    return ProbeStatus::Unsupported;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ffmpeg.hpp"
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// Minimal MP4 (ISO BMFF) / Matroska header parser: reads width, height and duration
+// from the container headers without ffmpeg, so it can run on a partially received upload.
+enum class ProbeStatus {
+    Found,
+    NeedMoreData,
+    Unsupported
+};
+
+// Fills `out` with [offset, offset + length), false if that range is not available yet
+using ProbeReader = std::function<bool(uint64_t offset, size_t length, std::vector<uint8_t>& out)>;
+
+extern ProbeStatus probe_header(const ProbeReader& read, uint64_t file_size, VideoMetadata& meta);
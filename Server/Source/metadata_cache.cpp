@@ -0,0 +1,142 @@
+#include "metadata_cache.hpp"
+
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <atomic>
+
+struct CacheKey {
+    int64_t chat_id;
+    int64_t message_id;
+
+    bool operator==(const CacheKey& other) const { return chat_id == other.chat_id && message_id == other.message_id; }
+};
+
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const
+    {
+        return std::hash<int64_t>()(key.chat_id) ^ (std::hash<int64_t>()(key.message_id) * 0x9E3779B97F4A7C15ULL);
+    }
+};
+
+struct CacheEntry {
+    CacheKey key;
+    std::optional<json> meta;
+    std::chrono::steady_clock::time_point expires;
+};
+
+static std::mutex cache_mutex;
+static std::list<CacheEntry> cache_entries; // most recently used first
+static std::unordered_map<CacheKey, std::list<CacheEntry>::iterator, CacheKeyHash> cache_index;
+
+static std::atomic<uint64_t> cache_generation = 0;
+static std::atomic<uint64_t> hits = 0;
+static std::atomic<uint64_t> negative_hits = 0;
+static std::atomic<uint64_t> misses = 0;
+static std::atomic<uint64_t> evictions = 0;
+static std::atomic<uint64_t> invalidations = 0;
+static std::atomic<uint64_t> stale_fills = 0;
+
+// Caller must hold cache_mutex
+static void erase_entry(std::list<CacheEntry>::iterator entry)
+{
+    cache_index.erase(entry->key);
+    cache_entries.erase(entry);
+}
+
+bool metadata_cache_get(int64_t chat_id, int64_t message_id, std::optional<json>& meta)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    auto it = cache_index.find({ chat_id, message_id });
+    if(it == cache_index.end()){
+        misses++;
+        return false;
+    }
+
+    if(std::chrono::steady_clock::now() >= it->second->expires){
+        erase_entry(it->second);
+        misses++;
+        return false;
+    }
+
+    cache_entries.splice(cache_entries.begin(), cache_entries, it->second);
+    meta = it->second->meta;
+
+    hits++;
+    if(!meta){
+        negative_hits++;
+    }
+    return true;
+}
+
+void metadata_cache_put(int64_t chat_id, int64_t message_id, std::optional<json> meta, uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // Invalidations take cache_mutex too, so the check cannot race with one
+    if(generation != cache_generation){
+        stale_fills++;
+        return;
+    }
+
+    CacheKey key = { chat_id, message_id };
+    auto expires = std::chrono::steady_clock::now() + METADATA_CACHE_TTL;
+
+    auto it = cache_index.find(key);
+    if(it != cache_index.end()){
+        it->second->meta = std::move(meta);
+        it->second->expires = expires;
+        cache_entries.splice(cache_entries.begin(), cache_entries, it->second);
+        return;
+    }
+
+    cache_entries.push_front({ key, std::move(meta), expires });
+    cache_index[key] = cache_entries.begin();
+
+    while(cache_entries.size() > METADATA_CACHE_ENTRIES){
+        erase_entry(std::prev(cache_entries.end()));
+        evictions++;
+    }
+}
+
+uint64_t metadata_cache_generation()
+{
+    return cache_generation;
+}
+
+void metadata_cache_invalidate(int64_t chat_id, int64_t message_id)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    cache_generation++;
+    invalidations++;
+
+    auto it = cache_index.find({ chat_id, message_id });
+    if(it != cache_index.end()){
+        erase_entry(it->second);
+    }
+}
+
+json metadata_cache_metrics()
+{
+    size_t size;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        size = cache_entries.size();
+    }
+
+    uint64_t hit_count = hits;
+    uint64_t lookups = hit_count + misses;
+    return {
+        {"size", size},
+        {"capacity", METADATA_CACHE_ENTRIES},
+        {"hits", hit_count},
+        {"negative_hits", negative_hits.load()},
+        {"misses", misses.load()},
+        {"hit_rate", lookups ? static_cast<double>(hit_count) / lookups : 0.0},
+        {"evictions", evictions.load()},
+        {"invalidations", invalidations.load()},
+        {"stale_fills", stale_fills.load()}
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+
+using json = nlohmann::json;
+
+// In-process cache of the latest video row per (chat_id, message_id), LRU bounded.
+// A message without metadata is cached too, so listings of unannotated chats stay off MySQL.
+inline constexpr size_t METADATA_CACHE_ENTRIES = 50000;
+inline constexpr auto METADATA_CACHE_TTL = std::chrono::minutes(10); // bounds staleness from writers outside this process
+
+// True on a hit; `meta` is empty when the message is known to have no metadata
+extern bool metadata_cache_get(int64_t chat_id, int64_t message_id, std::optional<json>& meta);
+
+// Read-through fill. `generation` is metadata_cache_generation() taken before the database read:
+// the value is dropped if an invalidation happened in between, since it may predate that write.
+extern void metadata_cache_put(int64_t chat_id, int64_t message_id, std::optional<json> meta, uint64_t generation);
+extern uint64_t metadata_cache_generation();
+
+extern void metadata_cache_invalidate(int64_t chat_id, int64_t message_id);
+extern json metadata_cache_metrics();
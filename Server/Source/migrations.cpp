@@ -0,0 +1,117 @@
+#include "migrations.hpp"
+#include "db.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+struct Migration {
+    int version;
+    const char* description;
+    bool (*apply)();
+};
+
+static bool execute(const std::string& sql)
+{
+    return db_query(sql).ok;
+}
+
+// CREATE INDEX has no IF NOT EXISTS in MySQL: a migration interrupted halfway must not fail on rerun
+static bool add_index(const std::string& table, const std::string& name, const std::string& columns, bool unique = false)
+{
+    if(db_index_exists(table, name)){
+        return true;
+    }
+
+    return execute(std::string(unique ? "CREATE UNIQUE INDEX " : "CREATE INDEX ") + name + " ON " + table + " (" + columns + ");");
+}
+
+static bool create_content_hash()
+{
+    return execute("CREATE TABLE IF NOT EXISTS content_hash(hash char(64) PRIMARY KEY, "
+                   "remote_file_id varchar(255), size bigint);");
+}
+
+static bool unique_telegram_video()
+{
+    // Older servers could insert the same message twice: keep the first row and move its videos.
+    // Plain subqueries (no UPDATE/DELETE ... JOIN) so the statements run on both backends; the
+    // DISTINCT derived table is materialized, which lets MySQL read telegram_video while deleting from it.
+    bool ok = execute("UPDATE video SET telegram_video_id = (SELECT MIN(keep_row.id) FROM telegram_video tv "
+                      "JOIN telegram_video keep_row ON keep_row.chat_id = tv.chat_id AND keep_row.message_id = tv.message_id "
+                      "WHERE tv.id = video.telegram_video_id) "
+                      "WHERE telegram_video_id IN (SELECT tv.id FROM telegram_video tv JOIN telegram_video keep_row "
+                      "ON keep_row.chat_id = tv.chat_id AND keep_row.message_id = tv.message_id AND keep_row.id < tv.id);")
+           && execute("DELETE FROM telegram_video WHERE id IN (SELECT id FROM (SELECT DISTINCT tv.id FROM telegram_video tv "
+                      "JOIN telegram_video keep_row ON keep_row.chat_id = tv.chat_id AND keep_row.message_id = tv.message_id "
+                      "AND keep_row.id < tv.id) duplicates);");
+
+    return ok && add_index("telegram_video", "uq_telegram_video_message", "chat_id, message_id", true);
+}
+
+static bool index_video_latest()
+{
+    // Covers "latest video of a telegram_video" (MAX(id) / ORDER BY id DESC) and the foreign key
+    return add_index("video", "idx_video_telegram_latest", "telegram_video_id, id");
+}
+
+static bool index_image_saved_filename()
+{
+    return add_index("image", "idx_image_saved_filename", "saved_filename");
+}
+
+// Append only: never renumber or edit a migration that has shipped
+static const std::vector<Migration> migrations = {
+    { 1, "content_hash table", create_content_hash },
+    { 2, "unique telegram_video (chat_id, message_id)", unique_telegram_video },
+    { 3, "video (telegram_video_id, id) index", index_video_latest },
+    { 4, "image saved_filename index", index_image_saved_filename },
+};
+
+int schema_version()
+{
+    DbResult result = db_query("SELECT COALESCE(MAX(version), 0) FROM schema_version;");
+    if(!result.ok || result.rows.empty()){
+        return -1;
+    }
+
+    return static_cast<int>(db_int(result.rows[0][0]));
+}
+
+int run_migrations()
+{
+    if(!execute("CREATE TABLE IF NOT EXISTS schema_version(version int PRIMARY KEY, "
+                "description varchar(255), applied_at timestamp DEFAULT CURRENT_TIMESTAMP);")){
+        std::cerr << "[ERROR] Failed to create schema_version table" << std::endl;
+        return -1;
+    }
+
+    int current = schema_version();
+    if(current < 0){
+        std::cerr << "[ERROR] Failed to read schema version" << std::endl;
+        return -1;
+    }
+
+    for(const Migration& migration : migrations){
+        if(migration.version <= current){
+            continue;
+        }
+
+        std::cout << "Applying migration " << migration.version << ": " << migration.description << std::endl;
+
+        if(!migration.apply()){
+            std::cerr << "[ERROR] Migration " << migration.version << " failed" << std::endl;
+            return -1;
+        }
+
+        if(!db_query("INSERT INTO schema_version(version, description) VALUES (?, ?);",
+                     { static_cast<int64_t>(migration.version), std::string(migration.description) }).ok){
+            std::cerr << "[ERROR] Failed to record migration " << migration.version << std::endl;
+            return -1;
+        }
+
+        current = migration.version;
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Schema changes are applied at startup, in order, and recorded in schema_version; a migration
+// that already ran is skipped, so the runner is safe to call on every start.
+extern int run_migrations();
+extern int schema_version();
@@ -16,6 +16,7 @@ ClientSession::ClientSession(uint32_t id): id(id)
 
     listener_thread = std::thread([this] {
         listener->poll([this](json r) {
+            chat_cache.apply(r);
             responses->push(r);
         });
     });
@@ -12,6 +12,7 @@
 #include <iostream>
 
 #include "common.hpp"
+#include "chat_cache.hpp"
 
 template<typename T>
 class CircularBuffer{
@@ -47,7 +48,27 @@ public:
         return items;
     }
 
-    std::pair<uint32_t, T> pop() 
+    // Like get_all, but gives up after `timeout` and returns an empty vector
+    std::vector<std::pair<uint32_t, T>> get_all_for(uint32_t last_checked, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        bool ready = notChecked.wait_for(lock, timeout, [this, last_checked] { return !buffer.empty() && buffer.back().first > last_checked; });
+
+        std::vector<std::pair<uint32_t, T>> items;
+        if(!ready){
+            return items;
+        }
+
+        for(auto it = buffer.begin(); it != buffer.end(); it++){
+            if(it->first > last_checked){
+                items.push_back(*it);
+            }
+        }
+
+        return items;
+    }
+
+    std::pair<uint32_t, T> pop()
     {
         std::unique_lock<std::mutex> lock(mtx);
         notEmpty.wait(lock, [this] { return !buffer.empty(); });
@@ -138,6 +159,7 @@ public:
     void send(const json &j);
 
     uint32_t getId() const { return id; }
+    ChatListCache& getChatCache() { return chat_cache; }
 
 private:
     void* td_instance = nullptr;
@@ -145,6 +167,7 @@ private:
     std::thread listener_thread;
     std::shared_ptr<CircularBuffer<json>> responses;
     std::mutex send_mutex;
+    ChatListCache chat_cache;
     uint32_t id = 0;
 };
 
@@ -0,0 +1,293 @@
+#include "staging.hpp"
+#include "io_engine.hpp"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+
+bool staging_open(StagingFile& file, const std::string& path, uint64_t size, bool direct_io)
+{
+    std::wstring wide_path = std::filesystem::u8path(path).wstring();
+    HANDLE handle = CreateFileW(wide_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(handle == INVALID_HANDLE_VALUE){
+        return false;
+    }
+
+    // Reserve the clusters up front instead of growing the file chunk by chunk
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    SetFileInformationByHandle(handle, FileAllocationInfo, &allocation, sizeof(allocation));
+
+    FILE_END_OF_FILE_INFO end_of_file;
+    end_of_file.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if(!SetFileInformationByHandle(handle, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file))){
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.handle = handle;
+    return true;
+}
+
+void staging_close(StagingFile& file)
+{
+    if(file.handle){
+        CloseHandle(static_cast<HANDLE>(file.handle));
+        file.handle = nullptr;
+    }
+}
+
+bool staging_write(StagingFile& file, uint64_t offset, const char* data, size_t length)
+{
+    while(length > 0){
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written = 0;
+        DWORD to_write = static_cast<DWORD>(std::min<size_t>(length, 1 << 30));
+        if(!WriteFile(static_cast<HANDLE>(file.handle), data, to_write, &written, &overlapped)){
+            return false;
+        }
+
+        data += written;
+        offset += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+bool staging_read(StagingFile& file, uint64_t offset, char* data, size_t length)
+{
+    while(length > 0){
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD read = 0;
+        if(!ReadFile(static_cast<HANDLE>(file.handle), data, static_cast<DWORD>(std::min<size_t>(length, 1 << 30)), &read, &overlapped) || read == 0){
+            return false;
+        }
+
+        data += read;
+        offset += read;
+        length -= read;
+    }
+
+    return true;
+}
+
+bool staging_is_direct(const StagingFile&)
+{
+    return false;
+}
+
+void staging_drop_cache(StagingFile&, uint64_t, uint64_t)
+{
+}
+
+#else
+
+// Reserves the blocks so chunk writes neither fragment the file nor update block maps.
+static bool preallocate(int fd, uint64_t size)
+{
+    if(size == 0){
+        return true;
+    }
+
+#if defined(__linux__)
+    if(fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0){
+        return true;
+    }
+
+    // EOPNOTSUPP/ENOSYS: the filesystem cannot do it, a sparse file still works
+    if(errno != EOPNOTSUPP && errno != ENOSYS){
+        return false;
+    }
+#elif defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+    if(fcntl(fd, F_PREALLOCATE, &store) == -1){
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fd, F_PREALLOCATE, &store);
+    }
+#endif
+
+    return ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+bool staging_open(StagingFile& file, const std::string& path, uint64_t size, bool direct_io)
+{
+    file.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(file.fd < 0){
+        return false;
+    }
+
+    if(!preallocate(file.fd, size)){
+        std::cerr << "[ERROR] Failed to preallocate " << path << ": " << strerror(errno) << std::endl;
+        staging_close(file);
+        return false;
+    }
+
+#if defined(__linux__) || defined(__FreeBSD__)
+    posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#ifdef O_DIRECT
+    if(direct_io && size >= STAGING_DIRECT_IO_MIN_SIZE){
+        // Not every filesystem accepts O_DIRECT (tmpfs): fall back to buffered writes
+        file.direct_fd = ::open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+    }
+#endif
+
+    return true;
+}
+
+void staging_close(StagingFile& file)
+{
+    if(file.direct_fd >= 0){
+        ::close(file.direct_fd);
+        file.direct_fd = -1;
+    }
+
+    if(file.fd >= 0){
+        ::close(file.fd);
+        file.fd = -1;
+    }
+}
+
+bool staging_write(StagingFile& file, uint64_t offset, const char* data, size_t length)
+{
+    return io_pwrite(file.fd, offset, data, length);
+}
+
+bool staging_read(StagingFile& file, uint64_t offset, char* data, size_t length)
+{
+    return io_pread(file.fd, offset, data, length);
+}
+
+bool staging_is_direct(const StagingFile& file)
+{
+    return file.direct_fd >= 0;
+}
+
+void staging_drop_cache(StagingFile& file, uint64_t offset, uint64_t length)
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+    posix_fadvise(file.fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#endif
+}
+
+#endif
+
+ChunkWriter::ChunkWriter(StagingFile& file, uint64_t offset) : file(file), offset(offset)
+{
+#ifndef _WIN32
+    if(staging_is_direct(file)){
+        head = (STAGING_DIRECT_IO_ALIGNMENT - offset % STAGING_DIRECT_IO_ALIGNMENT) % STAGING_DIRECT_IO_ALIGNMENT;
+
+        void* memory = nullptr;
+        if(posix_memalign(&memory, STAGING_DIRECT_IO_ALIGNMENT, STAGING_DIRECT_IO_BUFFER) == 0){
+            buffer = static_cast<char*>(memory);
+        }
+    }
+#endif
+}
+
+ChunkWriter::~ChunkWriter()
+{
+    free(buffer);
+}
+
+bool ChunkWriter::write(const char* data, size_t length)
+{
+    if(!buffer){
+        if(!staging_write(file, offset, data, length)){
+            return false;
+        }
+        offset += length;
+        return true;
+    }
+
+    // Unaligned start of the chunk
+    if(head > 0){
+        size_t length_head = std::min(head, length);
+        if(!staging_write(file, offset, data, length_head)){
+            return false;
+        }
+
+        offset += length_head;
+        head -= length_head;
+        data += length_head;
+        length -= length_head;
+    }
+
+    while(length > 0){
+        size_t copy = std::min(length, STAGING_DIRECT_IO_BUFFER - buffered);
+        memcpy(buffer + buffered, data, copy);
+        buffered += copy;
+        data += copy;
+        length -= copy;
+
+        if(buffered == STAGING_DIRECT_IO_BUFFER && !write_direct(buffered)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ChunkWriter::flush()
+{
+    if(!buffer || buffered == 0){
+        return true;
+    }
+
+    // Aligned part directly, the tail through the page cache
+    size_t aligned = buffered - buffered % STAGING_DIRECT_IO_ALIGNMENT;
+    size_t tail = buffered - aligned;
+
+    if(aligned > 0 && !write_direct(aligned)){
+        return false;
+    }
+
+    if(tail > 0){
+        if(!staging_write(file, offset, buffer, tail)){
+            return false;
+        }
+        offset += tail;
+        buffered = 0;
+    }
+
+    return true;
+}
+
+// Writes the first `length` buffered bytes (a multiple of the alignment) and keeps the rest
+bool ChunkWriter::write_direct(size_t length)
+{
+#ifndef _WIN32
+    if(!io_pwrite(file.direct_fd, offset, buffer, length)){
+        // Some filesystems accept O_DIRECT at open time and refuse the writes
+        if(errno != EINVAL || !staging_write(file, offset, buffer, length)){
+            return false;
+        }
+    }
+#endif
+
+    offset += length;
+    buffered -= length;
+    memmove(buffer, buffer + length, buffered);
+    return true;
+}
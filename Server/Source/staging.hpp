@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Uploads at least this large bypass the page cache (O_DIRECT, Linux only), so multi-GB
+// staging files do not evict the video ranges being streamed at the same time.
+inline constexpr bool STAGING_DIRECT_IO_ENABLED = false;
+inline constexpr uint64_t STAGING_DIRECT_IO_MIN_SIZE = 256 * 1024 * 1024;
+inline constexpr size_t STAGING_DIRECT_IO_ALIGNMENT = 4096;
+inline constexpr size_t STAGING_DIRECT_IO_BUFFER = 1024 * 1024;
+
+// Preallocated staging file written at explicit offsets.
+struct StagingFile {
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int fd = -1;
+    int direct_fd = -1; // second descriptor opened with O_DIRECT, -1 when direct I/O is off
+#endif
+};
+
+// `direct_io` only applies from STAGING_DIRECT_IO_MIN_SIZE on; the benchmark turns it on and off
+extern bool staging_open(StagingFile& file, const std::string& path, uint64_t size, bool direct_io = STAGING_DIRECT_IO_ENABLED);
+extern void staging_close(StagingFile& file);
+extern bool staging_write(StagingFile& file, uint64_t offset, const char* data, size_t length);
+extern bool staging_read(StagingFile& file, uint64_t offset, char* data, size_t length);
+extern bool staging_is_direct(const StagingFile& file);
+
+// Tells the kernel a range will not be read again through this process
+extern void staging_drop_cache(StagingFile& file, uint64_t offset, uint64_t length);
+
+// Writes one chunk body that arrives in small pieces. With direct I/O the pieces are gathered
+// in an aligned buffer and written in aligned blocks; the unaligned edges go through the page cache.
+class ChunkWriter{
+public:
+    ChunkWriter(StagingFile& file, uint64_t offset);
+    ~ChunkWriter();
+
+    bool write(const char* data, size_t length);
+
+    // Writes whatever is still buffered, call once after the last piece
+    bool flush();
+
+private:
+    bool write_direct(size_t length);
+
+    StagingFile& file;
+    uint64_t offset;
+    size_t head = 0; // bytes left before `offset` reaches an aligned boundary
+    char* buffer = nullptr;
+    size_t buffered = 0;
+};
@@ -0,0 +1,255 @@
+#include "storyboard.hpp"
+#include "ffmpeg.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <set>
+#include <map>
+#include <atomic>
+#include <algorithm>
+
+static const std::filesystem::path storyboards_dir = std::filesystem::u8path("UserData/Storyboards");
+
+static std::deque<std::pair<std::string, std::string>> storyboard_queue;
+static std::set<std::string> storyboard_scheduled;
+static std::map<std::string, std::chrono::steady_clock::time_point> storyboard_failed; // unique id -> time of the failure
+static std::mutex storyboard_mutex;
+static std::condition_variable storyboard_cv;
+static std::thread storyboard_thread;
+static std::atomic<bool> storyboard_running = false;
+
+bool is_valid_unique_id(const std::string& unique_id)
+{
+    if(unique_id.empty() || unique_id.size() > 128){
+        return false;
+    }
+
+    return std::all_of(unique_id.begin(), unique_id.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+    });
+}
+
+std::string get_storyboard_sheet_path(const std::string& unique_id, int sheet)
+{
+    if(!is_valid_unique_id(unique_id) || sheet < 0){
+        return "";
+    }
+
+    std::filesystem::path path = storyboards_dir / unique_id / ("sheet_" + std::to_string(sheet) + ".jpg");
+    std::error_code ec;
+    return std::filesystem::exists(path, ec) ? path.string() : "";
+}
+
+static bool write_file(const std::filesystem::path& path, const std::string& data)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    return static_cast<bool>(file);
+}
+
+static bool generate_storyboard(const std::string& unique_id, const std::string& source_path)
+{
+    AVFormatContext* fmt = nullptr;
+    if(avformat_open_input(&fmt, source_path.c_str(), nullptr, nullptr) != 0){
+        return false;
+    }
+
+    const AVCodec* decoder = nullptr;
+    int video_index = avformat_find_stream_info(fmt, nullptr) >= 0 ? av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0) : -1;
+    if(video_index < 0 || !decoder){
+        avformat_close_input(&fmt);
+        return false;
+    }
+
+    AVStream* stream = fmt->streams[video_index];
+    AVCodecContext* dec = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(dec, stream->codecpar);
+    dec->skip_frame = AVDISCARD_NONKEY; // only keyframes are ever shown
+
+    if(avcodec_open2(dec, decoder, nullptr) < 0 || dec->width <= 0 || dec->height <= 0){
+        avcodec_free_context(&dec);
+        avformat_close_input(&fmt);
+        return false;
+    }
+
+    int tile_width = STORYBOARD_TILE_WIDTH;
+    int tile_height = std::max(2, static_cast<int>(av_rescale(tile_width, dec->height, dec->width)) & ~1);
+    int per_sheet = STORYBOARD_COLUMNS * STORYBOARD_ROWS;
+
+    int64_t duration = fmt->duration != AV_NOPTS_VALUE ? fmt->duration : 0;
+    int64_t start_time = fmt->start_time != AV_NOPTS_VALUE ? fmt->start_time : 0;
+    int64_t interval = static_cast<int64_t>(STORYBOARD_INTERVAL_SECONDS) * AV_TIME_BASE;
+    int count = static_cast<int>(std::max<int64_t>(1, (duration + interval - 1) / interval));
+
+    std::filesystem::path dir = storyboards_dir / unique_id;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    AVFrame* sheet = nullptr;
+    bool ok = true;
+    int sheets = 0;
+
+    for(int i = 0; i < count && ok; i++){
+        int slot = i % per_sheet;
+
+        if(slot == 0){
+            int remaining = std::min(per_sheet, count - i);
+            int rows = (remaining + STORYBOARD_COLUMNS - 1) / STORYBOARD_COLUMNS;
+            int columns = std::min(remaining, STORYBOARD_COLUMNS);
+            sheet = alloc_picture(columns * tile_width, rows * tile_height);
+            ok = sheet != nullptr;
+            if(!ok) break;
+        }
+
+        int64_t target = av_rescale_q(start_time + i * interval, AV_TIME_BASE_Q, stream->time_base);
+        av_seek_frame(fmt, video_index, target, AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(dec);
+
+        bool got_frame = false;
+        while(!got_frame && av_read_frame(fmt, pkt) >= 0){
+            if(pkt->stream_index == video_index && avcodec_send_packet(dec, pkt) >= 0){
+                got_frame = avcodec_receive_frame(dec, frame) >= 0;
+            }
+            av_packet_unref(pkt);
+        }
+
+        if(got_frame){
+            int x = (slot % STORYBOARD_COLUMNS) * tile_width;
+            int y = (slot / STORYBOARD_COLUMNS) * tile_height;
+            scale_frame_into(frame, sheet, x, y, tile_width, tile_height);
+            av_frame_unref(frame);
+        }
+
+        if(slot == per_sheet - 1 || i == count - 1){
+            std::string jpeg;
+            ok = encode_jpeg(sheet, jpeg) && write_file(dir / ("sheet_" + std::to_string(sheets) + ".jpg"), jpeg);
+            av_frame_free(&sheet);
+            sheets++;
+        }
+    }
+
+    if(sheet) av_frame_free(&sheet);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec);
+    avformat_close_input(&fmt);
+
+    if(!ok){
+        std::filesystem::remove_all(dir, ec);
+        return false;
+    }
+
+    json index = {
+        {"interval", STORYBOARD_INTERVAL_SECONDS},
+        {"tile_width", tile_width},
+        {"tile_height", tile_height},
+        {"columns", STORYBOARD_COLUMNS},
+        {"rows", STORYBOARD_ROWS},
+        {"count", count},
+        {"sheets", sheets},
+        {"duration", duration / AV_TIME_BASE}
+    };
+
+    // Written last: its presence marks the storyboard as complete
+    return write_file(dir / "index.json.tmp", index.dump()) &&
+           (std::filesystem::rename(dir / "index.json.tmp", dir / "index.json", ec), !ec);
+}
+
+static void storyboard_worker()
+{
+    while(true){
+        std::pair<std::string, std::string> job;
+
+        {
+            std::unique_lock<std::mutex> lock(storyboard_mutex);
+            storyboard_cv.wait(lock, [] { return !storyboard_running || !storyboard_queue.empty(); });
+
+            if(!storyboard_running){
+                return;
+            }
+
+            job = storyboard_queue.front();
+            storyboard_queue.pop_front();
+        }
+
+        bool ok = generate_storyboard(job.first, job.second);
+        if(!ok){
+            std::cerr << "[ERROR] Failed to generate storyboard for " << job.first << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(storyboard_mutex);
+        storyboard_scheduled.erase(job.first);
+        if(!ok){
+            storyboard_failed[job.first] = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+void start_storyboards()
+{
+    if(storyboard_running){
+        return;
+    }
+
+    storyboard_running = true;
+    storyboard_thread = std::thread(storyboard_worker);
+}
+
+void stop_storyboards()
+{
+    {
+        std::lock_guard<std::mutex> lock(storyboard_mutex);
+        storyboard_running = false;
+    }
+    storyboard_cv.notify_all();
+
+    if(storyboard_thread.joinable()){
+        storyboard_thread.join();
+    }
+
+    // Whatever was still queued is scheduled again by the next request for it
+    std::lock_guard<std::mutex> lock(storyboard_mutex);
+    storyboard_queue.clear();
+    storyboard_scheduled.clear();
+}
+
+StoryboardState get_storyboard(const std::string& unique_id, const std::string& source_path, json& index)
+{
+    if(!is_valid_unique_id(unique_id)){
+        return StoryboardState::Failed;
+    }
+
+    std::ifstream file(storyboards_dir / unique_id / "index.json");
+    if(file){
+        try{
+            index = json::parse(file);
+            return StoryboardState::Ready;
+        }catch(const std::exception& e){
+            std::cerr << "[ERROR] Corrupted storyboard index for " << unique_id << ": " << e.what() << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(storyboard_mutex);
+
+    auto failed = storyboard_failed.find(unique_id);
+    if(failed != storyboard_failed.end()){
+        if(std::chrono::steady_clock::now() - failed->second < STORYBOARD_RETRY_BACKOFF){
+            return StoryboardState::Failed;
+        }
+        storyboard_failed.erase(failed);
+    }
+
+    if(storyboard_running && !source_path.empty() && storyboard_scheduled.insert(unique_id).second){
+        storyboard_queue.emplace_back(unique_id, source_path);
+        storyboard_cv.notify_one();
+    }
+
+    return StoryboardState::Pending;
+}
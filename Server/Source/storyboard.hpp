@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <chrono>
+
+// Seek-bar preview sprite sheets, generated lazily and cached per remote file id.
+inline constexpr int STORYBOARD_INTERVAL_SECONDS = 5;
+inline constexpr int STORYBOARD_TILE_WIDTH = 160;
+inline constexpr int STORYBOARD_COLUMNS = 10;
+inline constexpr int STORYBOARD_ROWS = 10;
+inline constexpr auto STORYBOARD_RETRY_BACKOFF = std::chrono::minutes(10); // before a failed storyboard is attempted again
+
+enum class StoryboardState {
+    Ready,
+    Pending,
+    Failed
+};
+
+extern void start_storyboards();
+extern void stop_storyboards();
+
+extern StoryboardState get_storyboard(const std::string& unique_id, const std::string& source_path, json& index);
+extern std::string get_storyboard_sheet_path(const std::string& unique_id, int sheet);
+extern bool is_valid_unique_id(const std::string& unique_id);
@@ -0,0 +1,180 @@
+#include "thumbnail.hpp"
+#include "ffmpeg.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Decodes the first frame at or after `position` (fraction of the duration) of a video or image file.
+static AVFrame* decode_frame(const std::string& path, double position)
+{
+    AVFormatContext* fmt = nullptr;
+    if(avformat_open_input(&fmt, path.c_str(), nullptr, nullptr) != 0){
+        return nullptr;
+    }
+
+    const AVCodec* decoder = nullptr;
+    int video_index = avformat_find_stream_info(fmt, nullptr) >= 0 ? av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0) : -1;
+    if(video_index < 0 || !decoder){
+        avformat_close_input(&fmt);
+        return nullptr;
+    }
+
+    AVStream* stream = fmt->streams[video_index];
+    AVCodecContext* dec = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(dec, stream->codecpar);
+
+    if(avcodec_open2(dec, decoder, nullptr) < 0){
+        avcodec_free_context(&dec);
+        avformat_close_input(&fmt);
+        return nullptr;
+    }
+
+    int64_t target = AV_NOPTS_VALUE;
+    if(position > 0 && fmt->duration != AV_NOPTS_VALUE && fmt->duration > 0){
+        int64_t start_time = fmt->start_time != AV_NOPTS_VALUE ? fmt->start_time : 0;
+        target = av_rescale_q(start_time + static_cast<int64_t>(fmt->duration * position), AV_TIME_BASE_Q, stream->time_base);
+        av_seek_frame(fmt, video_index, target, AVSEEK_FLAG_BACKWARD);
+    }
+
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    bool got_frame = false;
+    bool draining = false;
+
+    while(!got_frame){
+        if(!draining){
+            if(av_read_frame(fmt, pkt) < 0){
+                avcodec_send_packet(dec, nullptr);
+                draining = true;
+            }else{
+                if(pkt->stream_index == video_index){
+                    avcodec_send_packet(dec, pkt);
+                }
+                av_packet_unref(pkt);
+            }
+        }
+
+        while(avcodec_receive_frame(dec, frame) >= 0){
+            // After a backward seek, skip frames before the requested position
+            if(target == AV_NOPTS_VALUE || frame->best_effort_timestamp == AV_NOPTS_VALUE || frame->best_effort_timestamp >= target || draining){
+                got_frame = true;
+                break;
+            }
+            av_frame_unref(frame);
+        }
+
+        if(draining && !got_frame){
+            break;
+        }
+    }
+
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec);
+    avformat_close_input(&fmt);
+
+    if(!got_frame){
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    return frame;
+}
+
+static bool write_jpeg(const AVFrame* src, int width, const std::string& out_path)
+{
+    int height = std::max(2, static_cast<int>(av_rescale(width, src->height, src->width)) & ~1);
+    width &= ~1;
+
+    AVFrame* picture = alloc_picture(width, height);
+    if(!picture){
+        return false;
+    }
+
+    std::string jpeg;
+    bool ok = scale_frame_into(src, picture, 0, 0, width, height) && encode_jpeg(picture, jpeg, 3);
+    av_frame_free(&picture);
+
+    if(ok){
+        // Posters and variants go into directories nobody may have created yet
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::u8path(out_path).parent_path(), ec);
+
+        std::ofstream file(out_path, std::ios::binary | std::ios::trunc);
+        file.write(jpeg.data(), jpeg.size());
+        ok = static_cast<bool>(file);
+    }
+
+    return ok;
+}
+
+static std::string variant_path(const std::string& image_path, int width)
+{
+    std::filesystem::path path = std::filesystem::u8path(image_path);
+    return (path.parent_path() / (path.stem().string() + "_w" + std::to_string(width) + ".jpg")).string();
+}
+
+bool extract_poster(const std::string& video_path, const std::string& out_path)
+{
+    // 10% in usually skips black intro frames and title cards
+    AVFrame* frame = decode_frame(video_path, 0.1);
+    if(!frame){
+        frame = decode_frame(video_path, 0);
+    }
+
+    if(!frame){
+        std::cerr << "[ERROR] Could not extract a poster from " << video_path << std::endl;
+        return false;
+    }
+
+    bool ok = write_jpeg(frame, std::min(frame->width, POSTER_MAX_WIDTH), out_path);
+    av_frame_free(&frame);
+
+    if(ok){
+        generate_image_variants(out_path);
+    }
+
+    return ok;
+}
+
+void generate_image_variants(const std::string& image_path)
+{
+    AVFrame* frame = decode_frame(image_path, 0);
+    if(!frame){
+        std::cerr << "[ERROR] Could not decode image " << image_path << std::endl;
+        return;
+    }
+
+    for(int width : THUMBNAIL_VARIANT_WIDTHS){
+        if(width >= frame->width){
+            break; // never upscale, the original is served instead
+        }
+
+        write_jpeg(frame, width, variant_path(image_path, width));
+    }
+
+    av_frame_free(&frame);
+}
+
+std::string select_image_variant(const std::string& image_path, int width)
+{
+    if(width <= 0){
+        return image_path;
+    }
+
+    std::error_code ec;
+    for(int variant_width : THUMBNAIL_VARIANT_WIDTHS){
+        if(variant_width >= width){
+            std::string path = variant_path(image_path, variant_width);
+            return std::filesystem::exists(path, ec) ? path : image_path;
+        }
+    }
+
+    return image_path;
+}
+
+std::string poster_path(int64_t chat_id, int64_t message_id)
+{
+    return "UserData/Thumbnails/Posters/" + std::to_string(chat_id) + "_" + std::to_string(message_id) + ".jpg";
+}
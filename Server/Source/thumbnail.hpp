@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Widths pre-generated for every stored image, smallest first.
+inline constexpr int THUMBNAIL_VARIANT_WIDTHS[] = { 160, 320, 640 };
+inline constexpr int POSTER_MAX_WIDTH = 1280;
+
+extern bool extract_poster(const std::string& video_path, const std::string& out_path);
+extern void generate_image_variants(const std::string& image_path);
+extern std::string select_image_variant(const std::string& image_path, int width);
+extern std::string poster_path(int64_t chat_id, int64_t message_id);
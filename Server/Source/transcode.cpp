@@ -0,0 +1,734 @@
+#include "transcode.hpp"
+#include "common.hpp"
+
+extern "C" {
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/avutil.h>
+    #include <libavutil/opt.h>
+    #include <libswscale/swscale.h>
+}
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+static const std::filesystem::path renditions_dir = std::filesystem::u8path("UserData/Renditions");
+static constexpr auto active_view_window = std::chrono::minutes(2);
+
+struct WatchedFile {
+    std::string source_path;
+    uint32_t views = 0;
+    std::chrono::steady_clock::time_point last_view;
+};
+
+struct TranscodeJob {
+    std::string unique_id;
+    std::string source_path;
+    const RenditionProfile* profile = nullptr;
+};
+
+static std::unordered_map<std::string, WatchedFile> watched_files;
+static std::vector<TranscodeJob> pending_jobs;
+static std::set<std::string> scheduled_jobs; // "unique_id/quality", pending or running
+static std::vector<std::thread> workers;
+static std::mutex transcode_mutex;
+static std::condition_variable transcode_cv;
+static std::atomic<bool> transcode_running = false;
+
+static const RenditionProfile* find_profile(const std::string& quality)
+{
+    for(const auto& profile : RENDITION_PROFILES){
+        if(quality == profile.name){
+            return &profile;
+        }
+    }
+
+    return nullptr;
+}
+
+bool is_valid_quality(const std::string& quality)
+{
+    return find_profile(quality) != nullptr;
+}
+
+static std::filesystem::path rendition_path(const std::string& unique_id, const std::string& quality)
+{
+    return renditions_dir / unique_id / (quality + ".mp4");
+}
+
+static std::filesystem::path state_path(const std::string& unique_id, const std::string& quality)
+{
+    return renditions_dir / unique_id / (quality + ".state");
+}
+
+static std::filesystem::path parts_path(const std::string& unique_id, const std::string& quality)
+{
+    return renditions_dir / unique_id / (quality + ".parts");
+}
+
+static json load_state(const std::filesystem::path& path)
+{
+    std::ifstream file(path);
+    if(!file){
+        return json::object();
+    }
+
+    try{
+        return json::parse(file);
+    }catch(const std::exception& e){
+        std::cerr << "[ERROR] Corrupted transcode state " << path << ": " << e.what() << std::endl;
+        return json::object();
+    }
+}
+
+static void save_state(const std::filesystem::path& path, const json& state)
+{
+    std::filesystem::path tmp_path = path;
+    tmp_path += ".tmp";
+
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << state.dump();
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+}
+
+static uint64_t directory_size(const std::filesystem::path& dir)
+{
+    uint64_t total = 0;
+    std::error_code ec;
+
+    for(auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)){
+        if(it->is_regular_file(ec)){
+            total += it->file_size(ec);
+        }
+    }
+
+    return total;
+}
+
+// Removes the least recently served renditions until `needed` more bytes fit in the budget.
+static bool enforce_disk_budget(uint64_t needed)
+{
+    std::error_code ec;
+    if(!std::filesystem::exists(renditions_dir, ec)){
+        return needed <= TRANSCODE_DISK_BUDGET;
+    }
+
+    uint64_t used = directory_size(renditions_dir);
+    if(used + needed <= TRANSCODE_DISK_BUDGET){
+        return true;
+    }
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> finished;
+    for(auto it = std::filesystem::recursive_directory_iterator(renditions_dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)){
+        if(it->is_regular_file(ec) && it->path().extension() == ".mp4"){
+            finished.emplace_back(it->last_write_time(ec), it->path());
+        }
+    }
+
+    std::sort(finished.begin(), finished.end());
+
+    for(const auto& [time, path] : finished){
+        if(used + needed <= TRANSCODE_DISK_BUDGET){
+            break;
+        }
+
+        uint64_t size = std::filesystem::file_size(path, ec);
+        if(std::filesystem::remove(path, ec)){
+            std::filesystem::path state = path;
+            std::filesystem::remove(state.replace_extension(".state"), ec);
+            used -= std::min(used, size);
+            std::cout << "Evicted rendition " << path << std::endl;
+        }
+    }
+
+    return used + needed <= TRANSCODE_DISK_BUDGET;
+}
+
+struct TranscodeInput {
+    AVFormatContext* fmt = nullptr;
+    AVCodecContext* dec = nullptr;
+    int video_index = -1;
+    int audio_index = -1;
+};
+
+static void close_input(TranscodeInput& in)
+{
+    if(in.dec) avcodec_free_context(&in.dec);
+    if(in.fmt) avformat_close_input(&in.fmt);
+}
+
+static bool open_input(const std::string& path, TranscodeInput& in)
+{
+    if(avformat_open_input(&in.fmt, path.c_str(), nullptr, nullptr) != 0){
+        return false;
+    }
+
+    if(avformat_find_stream_info(in.fmt, nullptr) < 0){
+        close_input(in);
+        return false;
+    }
+
+    const AVCodec* decoder = nullptr;
+    in.video_index = av_find_best_stream(in.fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    in.audio_index = av_find_best_stream(in.fmt, AVMEDIA_TYPE_AUDIO, -1, in.video_index, nullptr, 0);
+
+    if(in.video_index < 0 || !decoder){
+        close_input(in);
+        return false;
+    }
+
+    in.dec = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(in.dec, in.fmt->streams[in.video_index]->codecpar);
+    in.dec->thread_count = 1; // the pool bounds CPU usage, not the codec
+
+    if(avcodec_open2(in.dec, decoder, nullptr) < 0){
+        close_input(in);
+        return false;
+    }
+
+    return true;
+}
+
+static const AVCodec* find_video_encoder()
+{
+    const AVCodec* encoder = avcodec_find_encoder_by_name("libx264");
+    if(!encoder) encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if(!encoder) encoder = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    return encoder;
+}
+
+static AVPixelFormat encoder_pixel_format(const AVCodec* encoder)
+{
+    const void* configs = nullptr;
+    int count = 0;
+
+    if(avcodec_get_supported_config(nullptr, encoder, AV_CODEC_CONFIG_PIX_FORMAT, 0, &configs, &count) >= 0 && configs && count > 0){
+        const AVPixelFormat* formats = static_cast<const AVPixelFormat*>(configs);
+        for(int i = 0; i < count; i++){
+            if(formats[i] == AV_PIX_FMT_YUV420P) return AV_PIX_FMT_YUV420P;
+        }
+        return formats[0];
+    }
+
+    return AV_PIX_FMT_YUV420P;
+}
+
+static int write_encoded_packets(AVCodecContext* enc, AVFormatContext* out, AVPacket* pkt)
+{
+    int ret;
+    while((ret = avcodec_receive_packet(enc, pkt)) >= 0){
+        av_packet_rescale_ts(pkt, enc->time_base, out->streams[0]->time_base);
+        pkt->stream_index = 0;
+        av_interleaved_write_frame(out, pkt);
+    }
+
+    return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+// Encodes [seg_start, seg_end) (AV_TIME_BASE units) into a standalone MPEG-TS file.
+// Timestamps are kept from the source so segments can be remuxed back to back.
+static bool encode_segment(TranscodeInput& in, const RenditionProfile& profile, int64_t seg_start, int64_t seg_end, const std::string& out_path)
+{
+    AVStream* in_video = in.fmt->streams[in.video_index];
+    AVStream* in_audio = in.audio_index >= 0 ? in.fmt->streams[in.audio_index] : nullptr;
+
+    const AVCodec* encoder = find_video_encoder();
+    if(!encoder){
+        std::cerr << "[ERROR] No video encoder available for renditions" << std::endl;
+        return false;
+    }
+
+    AVFormatContext* out = nullptr;
+    if(avformat_alloc_output_context2(&out, nullptr, "mpegts", out_path.c_str()) < 0){
+        return false;
+    }
+
+    AVCodecContext* enc = avcodec_alloc_context3(encoder);
+    AVRational frame_rate = av_guess_frame_rate(in.fmt, in_video, nullptr);
+    if(frame_rate.num <= 0 || frame_rate.den <= 0) frame_rate = { 30, 1 };
+
+    enc->height = profile.height;
+    enc->width = static_cast<int>(av_rescale(in.dec->width, profile.height, in.dec->height)) & ~1;
+    enc->pix_fmt = encoder_pixel_format(encoder);
+    enc->time_base = in_video->time_base;
+    enc->framerate = frame_rate;
+    enc->bit_rate = profile.video_bitrate;
+    enc->rc_max_rate = profile.video_bitrate * 3 / 2;
+    enc->rc_buffer_size = static_cast<int>(profile.video_bitrate * 2);
+    enc->gop_size = static_cast<int>(av_q2d(frame_rate) * 2);
+    enc->max_b_frames = 0; // keeps dts == pts across independently encoded segments
+    enc->thread_count = 1;
+    enc->sample_aspect_ratio = in.dec->sample_aspect_ratio;
+
+    if(out->oformat->flags & AVFMT_GLOBALHEADER){
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    bool ok = avcodec_open2(enc, encoder, nullptr) >= 0;
+
+    AVStream* out_video = ok ? avformat_new_stream(out, nullptr) : nullptr;
+    AVStream* out_audio = nullptr;
+
+    if(out_video){
+        avcodec_parameters_from_context(out_video->codecpar, enc);
+        out_video->time_base = enc->time_base;
+
+        if(in_audio){
+            out_audio = avformat_new_stream(out, nullptr);
+            avcodec_parameters_copy(out_audio->codecpar, in_audio->codecpar);
+            out_audio->codecpar->codec_tag = 0;
+            out_audio->time_base = in_audio->time_base;
+        }
+
+        ok = avio_open(&out->pb, out_path.c_str(), AVIO_FLAG_WRITE) >= 0 && avformat_write_header(out, nullptr) >= 0;
+    }else{
+        ok = false;
+    }
+
+    SwsContext* sws = nullptr;
+    AVFrame* frame = av_frame_alloc();
+    AVFrame* scaled = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    AVPacket* enc_pkt = av_packet_alloc();
+
+    if(ok){
+        scaled->format = enc->pix_fmt;
+        scaled->width = enc->width;
+        scaled->height = enc->height;
+        ok = av_frame_get_buffer(scaled, 0) >= 0;
+    }
+
+    if(ok){
+        av_seek_frame(in.fmt, -1, seg_start, AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(in.dec);
+    }
+
+    bool video_done = false;
+    bool audio_done = !in_audio;
+    bool first_frame = true;
+
+    auto handle_frames = [&]() {
+        while(ok && avcodec_receive_frame(in.dec, frame) >= 0){
+            int64_t pts = frame->best_effort_timestamp;
+            int64_t pts_us = av_rescale_q(pts, in_video->time_base, AV_TIME_BASE_Q);
+
+            if(pts_us >= seg_end){
+                video_done = true;
+            }
+
+            if(pts_us >= seg_start && pts_us < seg_end){
+                sws = sws_getCachedContext(sws, frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                           enc->width, enc->height, enc->pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+                if(!sws || av_frame_make_writable(scaled) < 0){
+                    ok = false;
+                    break;
+                }
+
+                sws_scale(sws, frame->data, frame->linesize, 0, frame->height, scaled->data, scaled->linesize);
+                scaled->pts = pts;
+                scaled->pict_type = first_frame ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+                first_frame = false;
+
+                if(avcodec_send_frame(enc, scaled) < 0 || write_encoded_packets(enc, out, enc_pkt) < 0){
+                    ok = false;
+                }
+            }
+
+            av_frame_unref(frame);
+        }
+    };
+
+    while(ok && !(video_done && audio_done) && transcode_running){
+        int ret = av_read_frame(in.fmt, pkt);
+        if(ret < 0){
+            // End of input: drain the decoder
+            avcodec_send_packet(in.dec, nullptr);
+            handle_frames();
+            break;
+        }
+
+        if(pkt->stream_index == in.video_index && !video_done){
+            if(avcodec_send_packet(in.dec, pkt) >= 0){
+                handle_frames();
+            }
+        }else if(in_audio && pkt->stream_index == in.audio_index && !audio_done && pkt->pts != AV_NOPTS_VALUE){
+            int64_t pts_us = av_rescale_q(pkt->pts, in_audio->time_base, AV_TIME_BASE_Q);
+
+            if(pts_us >= seg_end){
+                audio_done = true;
+            }else if(pts_us >= seg_start){
+                av_packet_rescale_ts(pkt, in_audio->time_base, out_audio->time_base);
+                pkt->stream_index = out_audio->index;
+                pkt->pos = -1;
+                av_interleaved_write_frame(out, pkt);
+            }
+        }
+
+        av_packet_unref(pkt);
+    }
+
+    if(ok){
+        avcodec_send_frame(enc, nullptr);
+        write_encoded_packets(enc, out, enc_pkt);
+        ok = av_write_trailer(out) >= 0 && transcode_running;
+    }
+
+    sws_freeContext(sws);
+    av_frame_free(&frame);
+    av_frame_free(&scaled);
+    av_packet_free(&pkt);
+    av_packet_free(&enc_pkt);
+    avcodec_free_context(&enc);
+    if(out->pb) avio_closep(&out->pb);
+    avformat_free_context(out);
+
+    return ok;
+}
+
+// Stream-copies the finished segments into a single progressive MP4.
+static bool concat_segments(const std::vector<std::string>& segments, const std::string& out_path)
+{
+    AVFormatContext* out = nullptr;
+    if(avformat_alloc_output_context2(&out, nullptr, "mp4", out_path.c_str()) < 0){
+        return false;
+    }
+
+    bool ok = true;
+    bool header_written = false;
+    std::vector<int64_t> last_dts;
+
+    for(const auto& segment : segments){
+        AVFormatContext* in = nullptr;
+        if(avformat_open_input(&in, segment.c_str(), nullptr, nullptr) != 0 || avformat_find_stream_info(in, nullptr) < 0){
+            if(in) avformat_close_input(&in);
+            ok = false;
+            break;
+        }
+
+        if(!header_written){
+            for(unsigned int i = 0; i < in->nb_streams; i++){
+                AVStream* stream = avformat_new_stream(out, nullptr);
+                avcodec_parameters_copy(stream->codecpar, in->streams[i]->codecpar);
+                stream->codecpar->codec_tag = 0;
+                stream->time_base = in->streams[i]->time_base;
+            }
+
+            AVDictionary* options = nullptr;
+            av_dict_set(&options, "movflags", "+faststart", 0);
+            ok = avio_open(&out->pb, out_path.c_str(), AVIO_FLAG_WRITE) >= 0 && avformat_write_header(out, &options) >= 0;
+            av_dict_free(&options);
+
+            header_written = ok;
+            last_dts.assign(out->nb_streams, AV_NOPTS_VALUE);
+        }
+
+        AVPacket* pkt = av_packet_alloc();
+        while(ok && av_read_frame(in, pkt) >= 0){
+            unsigned int index = static_cast<unsigned int>(pkt->stream_index);
+
+            if(index < out->nb_streams){
+                av_packet_rescale_ts(pkt, in->streams[index]->time_base, out->streams[index]->time_base);
+                pkt->pos = -1;
+
+                // Segments overlap by at most a frame around the cut points
+                if(pkt->dts == AV_NOPTS_VALUE || last_dts[index] == AV_NOPTS_VALUE || pkt->dts > last_dts[index]){
+                    if(pkt->dts != AV_NOPTS_VALUE) last_dts[index] = pkt->dts;
+                    av_interleaved_write_frame(out, pkt);
+                }
+            }
+
+            av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+        avformat_close_input(&in);
+    }
+
+    if(header_written){
+        ok = av_write_trailer(out) >= 0 && ok;
+    }
+
+    if(out->pb) avio_closep(&out->pb);
+    avformat_free_context(out);
+
+    return ok && header_written;
+}
+
+static void run_job(const TranscodeJob& job)
+{
+    const std::string quality = job.profile->name;
+    std::error_code ec;
+
+    std::filesystem::path parts = parts_path(job.unique_id, quality);
+    std::filesystem::path state_file = state_path(job.unique_id, quality);
+    std::filesystem::create_directories(parts, ec);
+
+    json state = load_state(state_file);
+    state["source_path"] = job.source_path;
+    int next_segment = state.value("next_segment", 0);
+
+    TranscodeInput in;
+    if(!open_input(job.source_path, in)){
+        std::cerr << "[ERROR] Failed to open rendition source: " << job.source_path << std::endl;
+        return;
+    }
+
+    if(in.dec->height <= job.profile->height){
+        // Never upscale: the original already fits this quality
+        state["skipped"] = true;
+        save_state(state_file, state);
+        close_input(in);
+        std::filesystem::remove_all(parts, ec);
+        return;
+    }
+
+    int64_t duration = in.fmt->duration != AV_NOPTS_VALUE ? in.fmt->duration : 0;
+    int64_t segment_length = static_cast<int64_t>(TRANSCODE_SEGMENT_SECONDS) * AV_TIME_BASE;
+    int segment_count = static_cast<int>(std::max<int64_t>(1, (duration + segment_length - 1) / segment_length));
+
+    uint64_t estimated_size = static_cast<uint64_t>(job.profile->video_bitrate / 8) * static_cast<uint64_t>(duration / AV_TIME_BASE + 1);
+    if(!enforce_disk_budget(estimated_size)){
+        std::cerr << "[ERROR] Rendition " << job.unique_id << "/" << quality << " does not fit in the disk budget" << std::endl;
+        close_input(in);
+        return;
+    }
+
+    state["segments"] = segment_count;
+    save_state(state_file, state);
+
+    std::vector<std::string> segment_files;
+    for(int i = 0; i < segment_count; i++){
+        char name[32];
+        snprintf(name, sizeof(name), "seg_%05d.ts", i);
+        segment_files.push_back((parts / name).string());
+    }
+
+    for(int i = next_segment; i < segment_count && transcode_running; i++){
+        int64_t seg_start = in.fmt->start_time != AV_NOPTS_VALUE ? in.fmt->start_time : 0;
+        seg_start += i * segment_length;
+
+        // Last segment takes whatever is left after the nominal duration
+        int64_t seg_end = (i == segment_count - 1) ? INT64_MAX : seg_start + segment_length;
+
+        if(!encode_segment(in, *job.profile, seg_start, seg_end, segment_files[i])){
+            if(transcode_running){
+                std::cerr << "[ERROR] Failed to encode segment " << i << " of " << job.unique_id << "/" << quality << std::endl;
+            }
+            close_input(in);
+            return;
+        }
+
+        state["next_segment"] = i + 1;
+        save_state(state_file, state);
+    }
+
+    close_input(in);
+
+    if(!transcode_running){
+        return; // resumed from next_segment at the next start
+    }
+
+    std::filesystem::path final_path = rendition_path(job.unique_id, quality);
+    std::filesystem::path tmp_path = final_path;
+    tmp_path += ".tmp";
+
+    if(concat_segments(segment_files, tmp_path.string())){
+        std::filesystem::rename(tmp_path, final_path, ec);
+        std::filesystem::remove_all(parts, ec);
+        state["done"] = true;
+        save_state(state_file, state);
+        std::cout << "Rendition ready: " << final_path << std::endl;
+    }else{
+        std::cerr << "[ERROR] Failed to assemble rendition " << final_path << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+    }
+}
+
+// Actively watched files first, then the most viewed ones.
+static size_t pick_next_job()
+{
+    auto now = std::chrono::steady_clock::now();
+    size_t best = 0;
+    uint64_t best_score = 0;
+
+    for(size_t i = 0; i < pending_jobs.size(); i++){
+        const WatchedFile& file = watched_files[pending_jobs[i].unique_id];
+        uint64_t score = file.views + 1;
+        if(now - file.last_view < active_view_window){
+            score += 1ULL << 32;
+        }
+
+        if(score > best_score){
+            best_score = score;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+static void worker_loop()
+{
+    while(true){
+        TranscodeJob job;
+
+        {
+            std::unique_lock<std::mutex> lock(transcode_mutex);
+            transcode_cv.wait(lock, [] { return !transcode_running || !pending_jobs.empty(); });
+
+            if(!transcode_running){
+                return;
+            }
+
+            size_t index = pick_next_job();
+            job = pending_jobs[index];
+            pending_jobs.erase(pending_jobs.begin() + index);
+        }
+
+        run_job(job);
+
+        std::lock_guard<std::mutex> lock(transcode_mutex);
+        scheduled_jobs.erase(job.unique_id + "/" + job.profile->name);
+    }
+}
+
+// Caller must hold transcode_mutex
+static void enqueue_job(const std::string& unique_id, const std::string& source_path, const RenditionProfile& profile)
+{
+    std::string key = unique_id + "/" + profile.name;
+    if(scheduled_jobs.count(key)){
+        return;
+    }
+
+    json state = load_state(state_path(unique_id, profile.name));
+    std::error_code ec;
+    if(state.value("skipped", false) || std::filesystem::exists(rendition_path(unique_id, profile.name), ec)){
+        return;
+    }
+
+    scheduled_jobs.insert(key);
+    pending_jobs.push_back({ unique_id, source_path, &profile });
+    transcode_cv.notify_one();
+}
+
+// Picks up jobs interrupted by a previous shutdown.
+static void resume_unfinished_jobs()
+{
+    std::error_code ec;
+    if(!std::filesystem::exists(renditions_dir, ec)){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(transcode_mutex);
+
+    for(const auto& dir : std::filesystem::directory_iterator(renditions_dir, ec)){
+        for(const auto& entry : std::filesystem::directory_iterator(dir.path(), ec)){
+            if(entry.path().extension() != ".state"){
+                continue;
+            }
+
+            json state = load_state(entry.path());
+            std::string quality = entry.path().stem().string();
+            const RenditionProfile* profile = find_profile(quality);
+            std::string source_path = state.value("source_path", "");
+
+            if(profile && !state.value("done", false) && !state.value("skipped", false) && std::filesystem::exists(source_path, ec)){
+                std::string unique_id = dir.path().filename().string();
+                watched_files[unique_id].source_path = source_path;
+                enqueue_job(unique_id, source_path, *profile);
+            }
+        }
+    }
+}
+
+void start_transcode_pool()
+{
+    if(!TRANSCODE_ENABLED || transcode_running){
+        return;
+    }
+
+    unsigned int count = TRANSCODE_MAX_WORKERS;
+    if(count == 0){
+        count = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+
+    transcode_running = true;
+    resume_unfinished_jobs();
+
+    for(unsigned int i = 0; i < count; i++){
+        workers.emplace_back(worker_loop);
+    }
+}
+
+void stop_transcode_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(transcode_mutex);
+        transcode_running = false;
+    }
+    transcode_cv.notify_all();
+
+    for(auto& worker : workers){
+        if(worker.joinable()){
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void transcode_record_view(const std::string& unique_id, const std::string& source_path, bool source_complete)
+{
+    if(!TRANSCODE_ENABLED || unique_id.empty()){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(transcode_mutex);
+
+    WatchedFile& file = watched_files[unique_id];
+    auto now = std::chrono::steady_clock::now();
+
+    // Range requests of the same playback count once
+    if(file.views == 0 || now - file.last_view > active_view_window){
+        file.views++;
+    }
+    file.last_view = now;
+    file.source_path = source_path;
+
+    if(transcode_running && source_complete && file.views >= TRANSCODE_VIEW_THRESHOLD){
+        for(const auto& profile : RENDITION_PROFILES){
+            enqueue_job(unique_id, source_path, profile);
+        }
+    }
+}
+
+std::string transcode_get_rendition(const std::string& unique_id, const std::string& quality)
+{
+    if(unique_id.empty() || !is_valid_quality(quality)){
+        return "";
+    }
+
+    std::filesystem::path path = rendition_path(unique_id, quality);
+    std::error_code ec;
+
+    if(!std::filesystem::exists(path, ec)){
+        return "";
+    }
+
+    // Used as recency for the disk budget eviction
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return path.string();
+}
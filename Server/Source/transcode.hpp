@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Background generation of lower-bitrate renditions for frequently watched videos.
+inline constexpr bool TRANSCODE_ENABLED = true;
+inline constexpr unsigned int TRANSCODE_MAX_WORKERS = 2;             // 0 = hardware_concurrency / 2
+inline constexpr uint32_t TRANSCODE_VIEW_THRESHOLD = 3;              // views before a rendition is queued
+inline constexpr int TRANSCODE_SEGMENT_SECONDS = 10;                 // unit of work saved for resuming
+inline constexpr uint64_t TRANSCODE_DISK_BUDGET = 20ULL * 1024 * 1024 * 1024;
+
+struct RenditionProfile {
+    const char* name;
+    int height;
+    int64_t video_bitrate;
+};
+
+inline constexpr RenditionProfile RENDITION_PROFILES[] = {
+    { "240p", 240, 300000 },
+    { "360p", 360, 700000 },
+    { "480p", 480, 1200000 },
+};
+
+extern void start_transcode_pool();
+extern void stop_transcode_pool();
+extern bool is_valid_quality(const std::string& quality);
+extern void transcode_record_view(const std::string& unique_id, const std::string& source_path, bool source_complete);
+extern std::string transcode_get_rendition(const std::string& unique_id, const std::string& quality);
@@ -0,0 +1,457 @@
+#include "upload.hpp"
+#include "io_engine.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+
+// The registry is split in shards so that concurrent chunks of different uploads
+// never contend on the same lock; each shard lock only guards a map lookup.
+static constexpr size_t UPLOAD_REGISTRY_SHARDS = 16;
+
+struct UploadShard {
+    std::unordered_map<std::string, std::shared_ptr<UploadFile>> uploads;
+    std::mutex mutex;
+};
+
+// Read size of hash_file
+static constexpr size_t HASH_READ_SIZE = 1024 * 1024;
+
+static UploadShard upload_shards[UPLOAD_REGISTRY_SHARDS];
+
+static std::thread sweeper_thread;
+static std::mutex sweeper_mutex;
+static std::condition_variable sweeper_cv;
+static bool sweeper_running = false;
+
+static UploadShard& shard_for(const std::string& path)
+{
+    return upload_shards[std::hash<std::string>{}(path) % UPLOAD_REGISTRY_SHARDS];
+}
+
+static std::string hex_digest(EVP_MD_CTX* ctx)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx, digest, &length);
+
+    static const char* hex = "0123456789abcdef";
+    std::string out;
+    for(unsigned int i = 0; i < length; i++){
+        out += hex[digest[i] >> 4];
+        out += hex[digest[i] & 0x0F];
+    }
+    return out;
+}
+
+// Caller must hold hash_mutex
+static void finish_hash(UploadFile& upload)
+{
+    if(upload.hash_ctx && upload.hashed == upload.size){
+        upload.content_hash = hex_digest(upload.hash_ctx);
+        EVP_MD_CTX_free(upload.hash_ctx);
+        upload.hash_ctx = nullptr;
+    }
+}
+
+UploadFile::~UploadFile()
+{
+    if(hash_ctx){
+        EVP_MD_CTX_free(hash_ctx);
+    }
+    staging_close(file);
+}
+
+// The chunk hashes into a copy of the context, so a chunk that fails its checksum leaves the hash untouched
+ChunkHasher::ChunkHasher(UploadFile& upload, uint64_t start) : upload(upload), start(start)
+{
+    std::lock_guard<std::mutex> lock(upload.hash_mutex);
+    if(!upload.hash_ctx || upload.hashing || upload.hashed != start){
+        return;
+    }
+
+    ctx = EVP_MD_CTX_new();
+    if(ctx && EVP_MD_CTX_copy_ex(ctx, upload.hash_ctx) != 1){
+        EVP_MD_CTX_free(ctx);
+        ctx = nullptr;
+    }
+
+    upload.hashing = ctx != nullptr;
+}
+
+ChunkHasher::~ChunkHasher()
+{
+    if(!ctx){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(upload.hash_mutex);
+    EVP_MD_CTX_free(ctx);
+    upload.hashing = false;
+}
+
+void ChunkHasher::update(const char* data, size_t size)
+{
+    if(ctx){
+        EVP_DigestUpdate(ctx, data, size);
+        length += size;
+    }
+}
+
+void ChunkHasher::commit()
+{
+    if(!ctx){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(upload.hash_mutex);
+    EVP_MD_CTX_free(upload.hash_ctx);
+    upload.hash_ctx = ctx;
+    upload.hashed = start + length;
+    upload.hashing = false;
+    ctx = nullptr;
+
+    finish_hash(upload);
+}
+
+StagingFileUse::StagingFileUse(UploadFile& upload) : upload(upload)
+{
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    if(!upload.file_closing){
+        upload.file_users++;
+        acquired = true;
+    }
+}
+
+StagingFileUse::~StagingFileUse()
+{
+    if(!acquired){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    if(--upload.file_users == 0 && upload.file_closing){
+        staging_close(upload.file);
+    }
+}
+
+std::shared_ptr<UploadFile> open_upload(const std::string& path, uint64_t size)
+{
+    UploadShard& shard = shard_for(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.uploads.find(path);
+    if(it != shard.uploads.end()){
+        return it->second;
+    }
+
+    auto upload = std::make_shared<UploadFile>();
+    upload->path = path;
+    upload->size = size;
+    upload->last_activity = std::chrono::steady_clock::now();
+
+    upload->hash_ctx = EVP_MD_CTX_new();
+    if(upload->hash_ctx && EVP_DigestInit_ex(upload->hash_ctx, EVP_sha256(), nullptr) != 1){
+        EVP_MD_CTX_free(upload->hash_ctx);
+        upload->hash_ctx = nullptr;
+    }
+
+    if(!staging_open(upload->file, path, size)){
+        std::cerr << "[ERROR] Failed to open staging file: " << path << std::endl;
+        return nullptr;
+    }
+
+    shard.uploads[path] = upload;
+    return upload;
+}
+
+bool upload_mark_received(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum)
+{
+    bool all_received;
+
+    {
+        std::lock_guard<std::mutex> lock(upload.mutex);
+        upload.received.add(start, end);
+        upload.chunks[start] = { end, checksum };
+        upload.writing.erase(start);
+        upload.last_activity = std::chrono::steady_clock::now();
+        all_received = upload.received.covered() == upload.size;
+    }
+
+    // Several chunks may finish at the same time: only one of them wins the completion
+    return all_received && !upload.completed.exchange(true);
+}
+
+bool upload_has_range(UploadFile& upload, uint64_t start, uint64_t end)
+{
+    if(upload.completed){
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    return upload.received.contains(start, end);
+}
+
+// Caller must hold upload.mutex
+static ChunkCheck check_chunk(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum)
+{
+    auto it = upload.chunks.find(start);
+    if(it != upload.chunks.end() && it->second.first == end){
+        // Exact retry: compared when both sides sent a checksum, never written again
+        const std::optional<uint32_t>& received = it->second.second;
+        return checksum && received && *received != *checksum ? ChunkCheck::Mismatch : ChunkCheck::Received;
+    }
+
+    if(upload.completed){
+        return ChunkCheck::Received;
+    }
+
+    auto writing = upload.writing.lower_bound(end);
+    bool in_flight = writing != upload.writing.begin() && std::prev(writing)->second > start;
+
+    return in_flight || upload.received.intersects(start, end) ? ChunkCheck::Overlap : ChunkCheck::Missing;
+}
+
+ChunkCheck upload_check_chunk(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum)
+{
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    return check_chunk(upload, start, end, checksum);
+}
+
+ChunkCheck upload_claim_chunk(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum)
+{
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    ChunkCheck check = check_chunk(upload, start, end, checksum);
+    if(check == ChunkCheck::Missing){
+        upload.writing[start] = end;
+        upload.last_activity = std::chrono::steady_clock::now();
+    }
+    return check;
+}
+
+// The chunk failed: its bytes were never counted, a retry claims and rewrites them
+void upload_release_chunk(UploadFile& upload, uint64_t start)
+{
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    upload.writing.erase(start);
+}
+
+uint64_t upload_contiguous_prefix(UploadFile& upload)
+{
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    return upload.received.contiguous_prefix();
+}
+
+// Hex SHA-256 of the whole upload, empty until every byte has been received
+std::string upload_content_hash(UploadFile& upload)
+{
+    std::lock_guard<std::mutex> lock(upload.hash_mutex);
+    return upload.content_hash;
+}
+
+void upload_hash_received(UploadFile& upload, uint64_t limit)
+{
+    uint64_t from, to;
+    EVP_MD_CTX* ctx;
+
+    {
+        std::lock_guard<std::mutex> hash_lock(upload.hash_mutex);
+        if(!upload.hash_ctx || upload.hashing){
+            return;
+        }
+
+        from = upload.hashed;
+        to = std::min(upload_contiguous_prefix(upload), limit > UINT64_MAX - from ? UINT64_MAX : from + limit);
+        if(to <= from){
+            return;
+        }
+
+        upload.hashing = true;
+        ctx = upload.hash_ctx;
+    }
+
+    // The bytes are read without the lock: `hashing` keeps chunks from touching the context meanwhile
+    StagingFileUse use(upload);
+    bool ok = static_cast<bool>(use);
+    IoBuffer buffer;
+    uint64_t offset = from;
+
+    while(ok && offset < to){
+        size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), to - offset));
+        ok = buffer.data() && staging_read(upload.file, offset, buffer.data(), length);
+        if(!ok){
+            break;
+        }
+
+        EVP_DigestUpdate(ctx, buffer.data(), length);
+
+        // Direct I/O kept the written data out of the cache: don't let the read-back put it there
+        if(staging_is_direct(upload.file)){
+            staging_drop_cache(upload.file, offset, length);
+        }
+
+        offset += length;
+    }
+
+    std::lock_guard<std::mutex> hash_lock(upload.hash_mutex);
+    upload.hashing = false;
+
+    if(!ok){
+        std::cerr << "[ERROR] Failed to hash staging file: " << upload.path << std::endl;
+        EVP_MD_CTX_free(upload.hash_ctx);
+        upload.hash_ctx = nullptr;
+        return;
+    }
+
+    upload.hashed = to;
+    finish_hash(upload);
+}
+
+// Same digest for a staging file that is no longer registered (e.g. a job resumed after a restart)
+std::string hash_file(const std::string& path)
+{
+    std::ifstream file(std::filesystem::u8path(path), std::ios::binary);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if(!file || !ctx || EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1){
+        EVP_MD_CTX_free(ctx);
+        return "";
+    }
+
+    std::vector<char> buffer(HASH_READ_SIZE);
+    while(file){
+        file.read(buffer.data(), buffer.size());
+        EVP_DigestUpdate(ctx, buffer.data(), file.gcount());
+    }
+
+    std::string digest = hex_digest(ctx);
+    EVP_MD_CTX_free(ctx);
+    return digest;
+}
+
+std::shared_ptr<UploadFile> find_upload(const std::string& path)
+{
+    UploadShard& shard = shard_for(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.uploads.find(path);
+    return it != shard.uploads.end() ? it->second : nullptr;
+}
+
+void forget_upload(const std::string& path)
+{
+    std::shared_ptr<UploadFile> upload;
+
+    {
+        UploadShard& shard = shard_for(path);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.uploads.find(path);
+        if(it == shard.uploads.end()){
+            return;
+        }
+
+        upload = it->second;
+        shard.uploads.erase(it);
+    }
+
+    // Chunks still writing and the hasher keep the descriptor until they are done with it
+    std::lock_guard<std::mutex> lock(upload->mutex);
+    upload->file_closing = true;
+    if(upload->file_users == 0){
+        staging_close(upload->file);
+    }
+}
+
+// The client gave up on these: nothing is writing or hashing them and no chunk came for
+// UPLOAD_IDLE_TIMEOUT. Completed uploads belong to their job, which forgets them when it is done.
+static void expire_idle_uploads()
+{
+    auto deadline = std::chrono::steady_clock::now() - UPLOAD_IDLE_TIMEOUT;
+    std::vector<std::string> expired;
+
+    for(UploadShard& shard : upload_shards){
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for(auto it = shard.uploads.begin(); it != shard.uploads.end(); ){
+            UploadFile& upload = *it->second;
+            std::lock_guard<std::mutex> upload_lock(upload.mutex);
+
+            if(upload.completed || !upload.writing.empty() || upload.file_users > 0 || upload.last_activity > deadline){
+                ++it;
+                continue;
+            }
+
+            // A chunk that already holds the upload now fails to acquire the file and answers 409
+            upload.file_closing = true;
+            staging_close(upload.file);
+            expired.push_back(it->first);
+            it = shard.uploads.erase(it);
+        }
+    }
+
+    for(const std::string& path : expired){
+        std::cout << "Expiring idle upload " << path << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::u8path(path), ec);
+    }
+}
+
+// Staging files of a previous run without a .job file next to them: the registry did not survive
+// the restart, so the client finds the upload unknown and starts over; only the space is left
+static void remove_orphaned_staging_files()
+{
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator("tmp", ec)){
+        if(!entry.is_regular_file(ec) || entry.path().extension() == ".job"){
+            continue;
+        }
+
+        std::filesystem::path job_file = entry.path();
+        job_file += ".job";
+        if(std::filesystem::exists(job_file, ec)){
+            continue;
+        }
+
+        std::cout << "Removing orphaned staging file " << entry.path().u8string() << std::endl;
+        std::filesystem::remove(entry.path(), ec);
+    }
+}
+
+static void sweeper_loop()
+{
+    std::unique_lock<std::mutex> lock(sweeper_mutex);
+    while(!sweeper_cv.wait_for(lock, UPLOAD_IDLE_SWEEP_INTERVAL, [] { return !sweeper_running; })){
+        lock.unlock();
+        expire_idle_uploads();
+        lock.lock();
+    }
+}
+
+void start_upload_registry()
+{
+    std::lock_guard<std::mutex> lock(sweeper_mutex);
+    if(sweeper_running){
+        return;
+    }
+
+    remove_orphaned_staging_files();
+    sweeper_running = true;
+    sweeper_thread = std::thread(sweeper_loop);
+}
+
+void stop_upload_registry()
+{
+    {
+        std::lock_guard<std::mutex> lock(sweeper_mutex);
+        if(!sweeper_running){
+            return;
+        }
+        sweeper_running = false;
+    }
+
+    sweeper_cv.notify_all();
+    sweeper_thread.join();
+}
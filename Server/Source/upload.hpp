@@ -0,0 +1,202 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include <openssl/evp.h>
+
+#include "staging.hpp"
+
+// An unfinished upload that got no chunk for UPLOAD_IDLE_TIMEOUT is dropped together with its
+// staging file, which is preallocated to the full size; checked every UPLOAD_IDLE_SWEEP_INTERVAL
+inline constexpr auto UPLOAD_IDLE_TIMEOUT = std::chrono::hours(2);
+inline constexpr auto UPLOAD_IDLE_SWEEP_INTERVAL = std::chrono::minutes(5);
+
+// Set of disjoint half-open byte ranges [start, end), merged on insertion.
+class IntervalSet{
+public:
+    // Returns the number of bytes that were not already covered
+    uint64_t add(uint64_t start, uint64_t end)
+    {
+        if(start >= end){
+            return 0;
+        }
+
+        uint64_t before = total;
+
+        auto it = intervals.upper_bound(start);
+        if(it != intervals.begin() && std::prev(it)->second >= start){
+            it = std::prev(it);
+        }
+
+        while(it != intervals.end() && it->first <= end){
+            start = std::min(start, it->first);
+            end = std::max(end, it->second);
+            total -= it->second - it->first;
+            it = intervals.erase(it);
+        }
+
+        intervals[start] = end;
+        total += end - start;
+
+        return total - before;
+    }
+
+    bool intersects(uint64_t start, uint64_t end) const
+    {
+        // Last interval starting before `end`: the intervals are disjoint, no earlier one reaches further
+        auto it = intervals.lower_bound(end);
+        return it != intervals.begin() && std::prev(it)->second > start;
+    }
+
+    bool contains(uint64_t start, uint64_t end) const
+    {
+        auto it = intervals.upper_bound(start);
+        if(it == intervals.begin()){
+            return false;
+        }
+
+        it = std::prev(it);
+        return it->first <= start && it->second >= end;
+    }
+
+    // Bytes available from offset 0 without holes
+    uint64_t contiguous_prefix() const
+    {
+        auto it = intervals.find(0);
+        return it != intervals.end() ? it->second : 0;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> missing(uint64_t size) const
+    {
+        std::vector<std::pair<uint64_t, uint64_t>> holes;
+        uint64_t cursor = 0;
+
+        for(const auto& [start, end] : intervals){
+            if(start > cursor){
+                holes.emplace_back(cursor, std::min(start, size));
+            }
+            cursor = std::max(cursor, end);
+        }
+
+        if(cursor < size){
+            holes.emplace_back(cursor, size);
+        }
+
+        return holes;
+    }
+
+    uint64_t covered() const { return total; }
+
+private:
+    std::map<uint64_t, uint64_t> intervals;
+    uint64_t total = 0;
+};
+
+// Staging file of an upload in progress, written chunk by chunk at explicit offsets.
+// Chunks write concurrently without locking, each into a range it claimed in `writing` so that
+// no two requests write the same bytes; `mutex` guards the ranges and the file users.
+// The content hash follows the contiguous prefix, `hash_mutex` guards the hash fields; while
+// `hashing` is set one chunk or job owns `hash_ctx` and feeds it without holding the lock.
+struct UploadFile {
+    std::string path;
+    uint64_t size = 0;
+    IntervalSet received;
+    std::map<uint64_t, std::pair<uint64_t, std::optional<uint32_t>>> chunks; // received chunk start -> (end, crc32c if sent)
+    std::map<uint64_t, uint64_t> writing; // chunks being written, start -> end
+    std::chrono::steady_clock::time_point last_activity; // last chunk claimed or received
+    std::atomic<bool> completed = false;
+    std::mutex mutex;
+    std::mutex hash_mutex;
+    EVP_MD_CTX* hash_ctx = nullptr;
+    uint64_t hashed = 0;
+    bool hashing = false;
+    std::string content_hash;
+    StagingFile file;
+    unsigned int file_users = 0;
+    bool file_closing = false;
+
+    ~UploadFile();
+};
+
+// Keeps the staging file open while a chunk or the hasher uses it. forget_upload closes the
+// file once the last user lets go; acquiring it after that fails.
+class StagingFileUse{
+public:
+    explicit StagingFileUse(UploadFile& upload);
+    ~StagingFileUse();
+
+    StagingFileUse(const StagingFileUse&) = delete;
+    StagingFileUse& operator=(const StagingFileUse&) = delete;
+
+    explicit operator bool() const { return acquired; }
+
+private:
+    UploadFile& upload;
+    bool acquired = false;
+};
+
+// Hashes a chunk body while it is written, when the chunk starts exactly where the hash stopped.
+// Chunks that arrive out of order are read back later by upload_hash_received, on an upload job.
+class ChunkHasher{
+public:
+    ChunkHasher(UploadFile& upload, uint64_t start);
+    ~ChunkHasher();
+
+    ChunkHasher(const ChunkHasher&) = delete;
+    ChunkHasher& operator=(const ChunkHasher&) = delete;
+
+    void update(const char* data, size_t length);
+
+    // Call once the chunk has been written and verified: the hash moves past it
+    void commit();
+
+private:
+    UploadFile& upload;
+    EVP_MD_CTX* ctx = nullptr;
+    uint64_t start;
+    uint64_t length = 0;
+};
+
+// Removes the staging files a previous run left without a job, then expires idle uploads in the background
+extern void start_upload_registry();
+extern void stop_upload_registry();
+
+extern std::shared_ptr<UploadFile> open_upload(const std::string& path, uint64_t size);
+
+// Only bytes nobody received or is writing can be written: a chunk that overlaps either is refused
+// before its body touches the file, unless it is an exact retry of a received chunk (not rewritten).
+enum class ChunkCheck {
+    Missing,
+    Received,
+    Mismatch, // already received with a different checksum
+    Overlap   // partly received, or overlapping a chunk still being written
+};
+
+extern ChunkCheck upload_check_chunk(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum);
+
+// Like upload_check_chunk, but a Missing range is claimed for writing until upload_mark_received
+// or upload_release_chunk
+extern ChunkCheck upload_claim_chunk(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum);
+extern void upload_release_chunk(UploadFile& upload, uint64_t start);
+extern bool upload_mark_received(UploadFile& upload, uint64_t start, uint64_t end, std::optional<uint32_t> checksum = std::nullopt);
+extern bool upload_has_range(UploadFile& upload, uint64_t start, uint64_t end);
+extern uint64_t upload_contiguous_prefix(UploadFile& upload);
+extern std::string upload_content_hash(UploadFile& upload);
+
+// Reads back and hashes at most `limit` received bytes that no chunk could hash while writing them
+extern void upload_hash_received(UploadFile& upload, uint64_t limit = UINT64_MAX);
+extern std::string hash_file(const std::string& path);
+extern std::shared_ptr<UploadFile> find_upload(const std::string& path);
+extern void forget_upload(const std::string& path);
@@ -0,0 +1,767 @@
+#include "upload_jobs.hpp"
+#include "session.hpp"
+#include "upload.hpp"
+#include "ffmpeg.hpp"
+#include "mediaprobe.hpp"
+#include "thumbnail.hpp"
+#include "db.hpp"
+#include "db_writer.hpp"
+#include "metadata_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <memory>
+
+struct UploadJob {
+    std::string path;
+    uint32_t session_id = 0;
+    int64_t chat_id = 0;
+    UploadJobState state = UploadJobState::Pending;
+    int64_t message_id = 0;
+    uint64_t size = 0;
+    uint64_t uploaded = 0;
+    int attempts = 0;
+    bool streaming = false;
+    bool complete = false; // every chunk was acknowledged, the staging file alone is enough to send it
+    bool probed = false;
+    VideoMetadata meta;
+    std::string content_hash;
+    std::string remote_file_id;
+};
+
+// Workers with their own queue and per-session limits
+struct JobPool {
+    std::deque<std::shared_ptr<UploadJob>> queue;
+    std::map<uint32_t, unsigned int> active_per_session;
+    std::vector<std::thread> workers;
+};
+
+static std::map<std::string, std::shared_ptr<UploadJob>> upload_jobs;
+static JobPool upload_pool;
+static JobPool streaming_pool;
+static std::mutex upload_jobs_mutex;
+static std::condition_variable upload_jobs_cv;
+static std::atomic<bool> upload_jobs_running = false;
+
+static const char* state_name(UploadJobState state)
+{
+    switch(state){
+        case UploadJobState::Pending: return "pending";
+        case UploadJobState::Sending: return "sending";
+        case UploadJobState::Uploaded: return "uploaded";
+        case UploadJobState::Recorded: return "recorded";
+        case UploadJobState::Failed: return "failed";
+    }
+    return "unknown";
+}
+
+static UploadJobState state_from_name(const std::string& name)
+{
+    if(name == "sending") return UploadJobState::Sending;
+    if(name == "uploaded") return UploadJobState::Uploaded;
+    if(name == "recorded") return UploadJobState::Recorded;
+    if(name == "failed") return UploadJobState::Failed;
+    return UploadJobState::Pending;
+}
+
+static std::string job_file(const UploadJob& job)
+{
+    return job.path + ".job";
+}
+
+// Caller must hold upload_jobs_mutex
+static void persist_job(const UploadJob& job)
+{
+    json j = {
+        {"path", job.path},
+        {"session_id", job.session_id},
+        {"chat_id", job.chat_id},
+        {"state", state_name(job.state)},
+        {"message_id", job.message_id},
+        {"attempts", job.attempts},
+        {"streaming", job.streaming},
+        {"complete", job.complete},
+        {"probed", job.probed},
+        {"meta", {
+            {"valid", job.meta.valid},
+            {"width", job.meta.width},
+            {"height", job.meta.height},
+            {"duration", job.meta.duration}
+        }},
+        {"content_hash", job.content_hash},
+        {"remote_file_id", job.remote_file_id}
+    };
+
+    std::string tmp_path = job_file(job) + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << j.dump();
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, job_file(job), ec);
+}
+
+static void set_state(UploadJob& job, UploadJobState state)
+{
+    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+    job.state = state;
+    persist_job(job);
+}
+
+static void finish_job(UploadJob& job)
+{
+    std::error_code ec;
+    std::string local_path = std::filesystem::absolute(job.path).string();
+
+    if(job.state == UploadJobState::Recorded){
+        // Copertina per set_video_data, finché il file è ancora in tmp/
+        extract_poster(local_path, poster_path(job.chat_id, job.message_id));
+    }
+
+    // Closes the staging descriptor first, the file cannot be removed while it is open on Windows
+    forget_upload(job.path);
+    std::filesystem::remove(local_path, ec);
+    std::filesystem::remove(job_file(job), ec);
+}
+
+// File that TDLib asked us to generate for a streaming job
+struct Generation {
+    int64_t id = 0;
+    std::string destination;
+    uint64_t written = 0;
+    bool finished = false;
+};
+
+// Copies the newly arrived prefix of the staging file into the file TDLib is generating.
+static bool pump_generation(UploadJob& job, Generation& generation, std::shared_ptr<ClientSession> session)
+{
+    std::shared_ptr<UploadFile> upload = find_upload(job.path);
+    uint64_t available = upload ? upload_contiguous_prefix(*upload) : job.size;
+
+    if(available > generation.written){
+        std::ifstream in(job.path, std::ios::binary);
+        std::ofstream out(generation.destination, std::ios::binary | std::ios::in | std::ios::out);
+        if(!out){
+            out.open(generation.destination, std::ios::binary | std::ios::trunc);
+        }
+
+        in.seekg(generation.written);
+        out.seekp(generation.written);
+
+        std::vector<char> buffer(1024 * 1024);
+        while(generation.written < available && in && out){
+            size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), available - generation.written));
+            in.read(buffer.data(), length);
+            out.write(buffer.data(), in.gcount());
+            generation.written += in.gcount();
+        }
+
+        if(!out){
+            return false;
+        }
+
+        session->send({
+            {"@type", "setFileGenerationProgress"},
+            {"generation_id", std::to_string(generation.id)},
+            {"expected_size", job.size},
+            {"local_prefix_size", generation.written}
+        });
+    }
+
+    if(generation.written == job.size && !generation.finished){
+        session->send({
+            {"@type", "finishFileGeneration"},
+            {"generation_id", std::to_string(generation.id)}
+        });
+        generation.finished = true;
+    }
+
+    return true;
+}
+
+// Reads width, height and duration from the container headers as soon as they have been
+// received; the full ffmpeg probe only runs on complete files the parser could not handle.
+static void resolve_metadata(UploadJob& job)
+{
+    std::shared_ptr<UploadFile> upload = find_upload(job.path);
+    std::ifstream file(job.path, std::ios::binary);
+    auto deadline = std::chrono::steady_clock::now() + UPLOAD_PROBE_MAX_WAIT;
+
+    ProbeReader reader = [&](uint64_t offset, size_t length, std::vector<uint8_t>& out) {
+        if(upload && !upload_has_range(*upload, offset, offset + length)){
+            return false;
+        }
+
+        out.resize(length);
+        file.clear();
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(out.data()), length);
+        return static_cast<size_t>(file.gcount()) == length;
+    };
+
+    while(upload_jobs_running){
+        VideoMetadata meta;
+        ProbeStatus status = probe_header(reader, job.size, meta);
+        bool complete = !upload || upload->completed;
+
+        if(status == ProbeStatus::Found){
+            job.meta = meta;
+            break;
+        }
+
+        if(complete){
+            // Sometimes Telegram is not able to get video metadata, so I do it here manually.
+            job.meta = get_video_metadata(std::filesystem::absolute(job.path).string());
+            break;
+        }
+
+        // Streaming: don't hold the Telegram upload back for a header that may only come at the end
+        if(status == ProbeStatus::Unsupported || std::chrono::steady_clock::now() > deadline){
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+
+    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+    job.probed = true;
+    persist_job(job);
+}
+
+// Content hash of a fully received upload, empty while chunks are still missing.
+// Chunks hash themselves when they arrive in order; the rest is read back here, on the job.
+static std::string job_content_hash(const UploadJob& job)
+{
+    std::shared_ptr<UploadFile> upload = find_upload(job.path);
+    if(!upload){
+        return hash_file(job.path);
+    }
+
+    if(!upload->completed){
+        return "";
+    }
+
+    upload_hash_received(*upload);
+    std::string content_hash = upload_content_hash(*upload);
+    return content_hash.empty() ? hash_file(job.path) : content_hash;
+}
+
+// Remote file id of a video with the same content that was already sent to Telegram
+static std::string find_remote_file(const std::string& content_hash)
+{
+    DbResult result = db_query("SELECT remote_file_id FROM content_hash WHERE hash = ?", { content_hash });
+    return result.rows.empty() ? "" : db_string(result.rows[0][0]);
+}
+
+// Records the sent message and, when known, the remote file of its content; both rows are committed
+// together. Waits for the write-behind flush, so the job is only marked recorded once they are stored.
+static bool record_job(const UploadJob& job)
+{
+    std::vector<DbWrite> rows = {
+        { "telegram_video", { "message_id", "chat_id" }, { job.message_id, job.chat_id }, db_on_conflict_ignore("chat_id, message_id") }
+    };
+
+    if(!job.content_hash.empty() && !job.remote_file_id.empty()){
+        rows.push_back({ "content_hash", { "hash", "remote_file_id", "size" },
+                         { job.content_hash, job.remote_file_id, static_cast<int64_t>(job.size) },
+                         db_on_conflict_update("hash", { "remote_file_id" }) });
+    }
+
+    auto committed = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = committed->get_future();
+    db_write_async(std::move(rows), [committed](bool ok) { committed->set_value(ok); });
+    return result.get();
+}
+
+// send_video gave up a streaming upload because Telegram already has the same content
+static constexpr int64_t SEND_SUPERSEDED = -1;
+
+// Sends the video and waits for Telegram to confirm the message. Returns the final message id, 0 on failure.
+// Streaming jobs start while chunks are still arriving: TDLib reads the file as a generated
+// file whose prefix grows with the client upload, so both transfers overlap.
+// With a `remote_file_id` the file Telegram already has is sent again and nothing is uploaded.
+// A streaming job hashes the content as it arrives; if it turns out to be a duplicate before the
+// upload is done, the pending message is deleted (which cancels the upload) and SEND_SUPERSEDED returned.
+static int64_t send_video(UploadJob& job, const std::string& remote_file_id = "")
+{
+    std::shared_ptr<ClientSession> session = getSession(job.session_id);
+    std::string local_path = std::filesystem::absolute(job.path).string();
+    std::string extra = "upload:" + job.path;
+
+    json content = {
+        {"@type", "inputMessageVideo"},
+        {"supports_streaming", true}
+    };
+
+    if(!remote_file_id.empty()){
+        content["video"] = {
+            {"@type", "inputFileRemote"},
+            {"id", remote_file_id}
+        };
+    }else if(job.streaming){
+        content["video"] = {
+            {"@type", "inputFileGenerated"},
+            {"original_path", local_path},
+            {"conversion", UPLOAD_GENERATION_CONVERSION},
+            {"expected_size", job.size}
+        };
+    }else{
+        content["video"] = {
+            {"@type", "inputFileLocal"},
+            {"path", local_path}
+        };
+    }
+
+    if(!job.probed){
+        resolve_metadata(job);
+    }
+
+    if(job.meta.valid){
+        content["duration"] = job.meta.duration;
+        content["width"] = job.meta.width;
+        content["height"] = job.meta.height;
+    }
+
+    session->send({
+        {"@type", "sendMessage"},
+        {"chat_id", job.chat_id},
+        {"input_message_content", content},
+        {"@extra", extra}
+    });
+
+    uint32_t last_checked = 0;
+    int64_t pending_message_id = 0;
+    int64_t file_id = 0;
+    Generation generation;
+    bool check_duplicate = job.streaming && remote_file_id.empty() && job.content_hash.empty();
+    auto last_progress = std::chrono::steady_clock::now();
+
+    while(upload_jobs_running){
+        auto responses = session->getResponses()->get_all_for(last_checked, std::chrono::milliseconds(250));
+
+        for(const auto& [id, response] : responses){
+            last_checked = id;
+
+            if(response.value("@extra", "") == extra){
+                if(response["@type"] == "message"){
+                    pending_message_id = response["id"];
+                    file_id = response["content"]["video"]["video"]["id"];
+                }else if(response["@type"] == "error"){
+                    std::cerr << "[ERROR] sendMessage failed for " << job.path << ": " << response.dump() << std::endl;
+                    return 0;
+                }
+            }else if(response["@type"] == "updateFileGenerationStart" && response["original_path"] == local_path &&
+                     response["conversion"] == UPLOAD_GENERATION_CONVERSION){
+                generation.id = std::stoll(response["generation_id"].get<std::string>());
+                generation.destination = response["destination_path"];
+                generation.written = 0;
+                generation.finished = false;
+            }else if(response["@type"] == "updateFile" && file_id != 0 && response["file"]["id"] == file_id){
+                std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+                job.uploaded = response["file"]["remote"]["uploaded_size"];
+                last_progress = std::chrono::steady_clock::now();
+            }else if(pending_message_id != 0 && response.value("old_message_id", int64_t(0)) == pending_message_id){
+                if(response["@type"] == "updateMessageSendSucceeded"){
+                    const json& video = response["message"]["content"];
+                    if(video.contains("video")){
+                        std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+                        job.remote_file_id = video["video"]["video"]["remote"].value("id", "");
+                    }
+                    return response["message"]["id"];
+                }
+
+                if(response["@type"] == "updateMessageSendFailed"){
+                    std::cerr << "[ERROR] Telegram rejected " << job.path << ": " << response["error"].dump() << std::endl;
+                    return 0;
+                }
+            }
+        }
+
+        if(generation.id != 0 && !generation.finished){
+            uint64_t before = generation.written;
+            if(!pump_generation(job, generation, session)){
+                std::cerr << "[ERROR] Failed to write generated file for " << job.path << std::endl;
+                session->send({
+                    {"@type", "finishFileGeneration"},
+                    {"generation_id", std::to_string(generation.id)},
+                    {"error", {{"@type", "error"}, {"code", 500}, {"message", "Write failed"}}}
+                });
+                return 0;
+            }
+
+            if(generation.written > before){
+                last_progress = std::chrono::steady_clock::now();
+            }
+        }
+
+        if(check_duplicate && pending_message_id != 0){
+            std::shared_ptr<UploadFile> upload = find_upload(job.path);
+            if(upload){
+                upload_hash_received(*upload, UPLOAD_HASH_STEP);
+            }
+
+            std::string content_hash = upload && upload->completed ? upload_content_hash(*upload) : "";
+            if(!content_hash.empty()){
+                check_duplicate = false;
+                {
+                    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+                    job.content_hash = content_hash;
+                    persist_job(job);
+                }
+
+                if(!find_remote_file(content_hash).empty()){
+                    if(generation.id != 0 && !generation.finished){
+                        session->send({
+                            {"@type", "finishFileGeneration"},
+                            {"generation_id", std::to_string(generation.id)},
+                            {"error", {{"@type", "error"}, {"code", 400}, {"message", "Duplicate content"}}}
+                        });
+                    }
+
+                    session->send({
+                        {"@type", "deleteMessages"},
+                        {"chat_id", job.chat_id},
+                        {"message_ids", { pending_message_id }},
+                        {"revoke", true}
+                    });
+                    return SEND_SUPERSEDED;
+                }
+            }
+        }
+
+        if(std::chrono::steady_clock::now() - last_progress > UPLOAD_JOB_STALL_TIMEOUT){
+            std::cerr << "[ERROR] Upload of " << job.path << " stalled" << std::endl;
+            if(generation.id != 0 && !generation.finished){
+                session->send({
+                    {"@type", "finishFileGeneration"},
+                    {"generation_id", std::to_string(generation.id)},
+                    {"error", {{"@type", "error"}, {"code", 408}, {"message", "Upload stalled"}}}
+                });
+            }
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+// Sends the remote file of an earlier upload with the same content, if there is one. Returns 0 otherwise.
+static int64_t send_duplicate(UploadJob& job)
+{
+    std::string remote_file_id = job.content_hash.empty() ? "" : find_remote_file(job.content_hash);
+    if(remote_file_id.empty()){
+        return 0;
+    }
+
+    int64_t message_id = send_video(job, remote_file_id);
+    if(message_id == 0 && upload_jobs_running){
+        // The remote file is gone or belongs to an account this session cannot use
+        std::cerr << "[ERROR] Could not reuse remote file for " << job.path << ", uploading it again" << std::endl;
+        db_query("DELETE FROM content_hash WHERE hash = ?", { job.content_hash });
+    }
+
+    return message_id;
+}
+
+static void run_job(UploadJob& job)
+{
+    if(job.state == UploadJobState::Pending || job.state == UploadJobState::Sending){
+        set_state(job, UploadJobState::Sending);
+
+        // Known up front when the file is complete; a streaming job still receiving finds it in send_video
+        if(job.content_hash.empty()){
+            std::string content_hash = job_content_hash(job);
+            std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+            job.content_hash = content_hash;
+            persist_job(job);
+        }
+
+        int64_t message_id = send_duplicate(job);
+        if(message_id == 0 && upload_jobs_running){
+            message_id = send_video(job);
+
+            if(message_id == SEND_SUPERSEDED){
+                message_id = send_duplicate(job);
+                if(message_id == 0 && upload_jobs_running){
+                    message_id = send_video(job);
+                }
+            }
+        }
+        if(message_id == 0){
+            if(!upload_jobs_running){
+                return; // resumed at the next start
+            }
+
+            std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+            job.attempts++;
+            job.state = job.attempts < UPLOAD_JOB_MAX_ATTEMPTS ? UploadJobState::Pending : UploadJobState::Failed;
+            persist_job(job);
+            return;
+        }
+
+        std::string content_hash = job.content_hash.empty() ? job_content_hash(job) : job.content_hash;
+
+        std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+        job.content_hash = content_hash;
+        job.message_id = message_id;
+        job.uploaded = job.size;
+        job.state = UploadJobState::Uploaded;
+        persist_job(job);
+    }
+
+    if(job.state == UploadJobState::Uploaded){
+        if(!record_job(job)){
+            std::cerr << "[ERROR] Failed to record upload " << job.path << " in the database" << std::endl;
+            return; // stays uploaded, recorded again at the next start
+        }
+        metadata_cache_invalidate(job.chat_id, job.message_id);
+        set_state(job, UploadJobState::Recorded);
+    }
+}
+
+static JobPool& pool_for(const UploadJob& job)
+{
+    return job.streaming ? streaming_pool : upload_pool;
+}
+
+// Caller must hold upload_jobs_mutex
+static void add_job(std::shared_ptr<UploadJob> job)
+{
+    std::error_code ec;
+    job->size = std::filesystem::file_size(job->path, ec);
+
+    upload_jobs[job->path] = job;
+    pool_for(*job).queue.push_back(job);
+    persist_job(*job);
+    upload_jobs_cv.notify_all(); // both pools wait on it
+}
+
+static void worker_loop(JobPool& pool)
+{
+    while(true){
+        std::shared_ptr<UploadJob> job;
+
+        {
+            std::unique_lock<std::mutex> lock(upload_jobs_mutex);
+
+            // First queued job whose session is below its concurrency limit
+            auto eligible = [&]() {
+                for(auto it = pool.queue.begin(); it != pool.queue.end(); it++){
+                    if(pool.active_per_session[(*it)->session_id] < UPLOAD_JOBS_PER_SESSION){
+                        return it;
+                    }
+                }
+                return pool.queue.end();
+            };
+
+            upload_jobs_cv.wait(lock, [&] { return !upload_jobs_running || eligible() != pool.queue.end(); });
+
+            if(!upload_jobs_running){
+                return;
+            }
+
+            auto it = eligible();
+            job = *it;
+            pool.queue.erase(it);
+            pool.active_per_session[job->session_id]++;
+        }
+
+        run_job(*job);
+
+        bool done = job->state == UploadJobState::Recorded || job->state == UploadJobState::Failed;
+
+        // A streaming job that gave up while chunks are still arriving leaves the staging file and the
+        // upload entry to the client: its last chunk enqueues a regular job for the complete file
+        std::shared_ptr<UploadFile> upload = find_upload(job->path);
+        bool receiving = job->streaming && job->state == UploadJobState::Failed && upload && !upload->completed;
+
+        if(done && !receiving){
+            finish_job(*job);
+        }
+
+        std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+        pool.active_per_session[job->session_id]--;
+
+        if(job->state == UploadJobState::Pending && upload_jobs_running){
+            pool_for(*job).queue.push_back(job); // retry
+        }else if(done){
+            upload_jobs.erase(job->path);
+        }
+
+        if(receiving){
+            std::error_code ec;
+            std::filesystem::remove(job_file(*job), ec);
+
+            // The last chunk may have landed in the meantime and found this job still registered
+            if(upload->completed){
+                auto retry = std::make_shared<UploadJob>();
+                retry->path = job->path;
+                retry->session_id = job->session_id;
+                retry->chat_id = job->chat_id;
+                retry->complete = true;
+                add_job(retry);
+            }
+        }
+
+        upload_jobs_cv.notify_all();
+    }
+}
+
+// Re-enqueues the jobs left unfinished by a previous run.
+static void recover_jobs()
+{
+    std::error_code ec;
+    if(!std::filesystem::exists("tmp", ec)){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+
+    for(const auto& entry : std::filesystem::directory_iterator("tmp", ec)){
+        if(entry.path().extension() != ".job"){
+            continue;
+        }
+
+        json j;
+        try{
+            std::ifstream file(entry.path());
+            j = json::parse(file);
+        }catch(const std::exception& e){
+            std::cerr << "[ERROR] Corrupted upload job " << entry.path() << ": " << e.what() << std::endl;
+            continue;
+        }
+
+        auto job = std::make_shared<UploadJob>();
+        job->path = j.value("path", "");
+        job->session_id = j.value("session_id", 0u);
+        job->chat_id = j.value("chat_id", int64_t(0));
+        job->state = state_from_name(j.value("state", "pending"));
+        job->message_id = j.value("message_id", int64_t(0));
+        job->attempts = j.value("attempts", 0);
+
+        job->streaming = j.value("streaming", false);
+        job->complete = j.value("complete", false);
+        job->probed = j.value("probed", false);
+        if(j.contains("meta")){
+            job->meta.valid = j["meta"].value("valid", false);
+            job->meta.width = j["meta"].value("width", 0);
+            job->meta.height = j["meta"].value("height", 0);
+            job->meta.duration = j["meta"].value("duration", 0);
+        }
+        job->content_hash = j.value("content_hash", "");
+        job->remote_file_id = j.value("remote_file_id", "");
+
+        // A streaming job whose upload had completed is sent again as a regular job: the client got a
+        // 200 for every chunk and will not retry. One that died together with the chunks it was
+        // waiting for is dropped, the client finds the upload unknown and starts it over.
+        bool interrupted_stream = job->streaming && (job->state == UploadJobState::Pending || job->state == UploadJobState::Sending);
+        if(interrupted_stream && job->complete){
+            job->streaming = false;
+            job->state = UploadJobState::Pending;
+            job->message_id = 0;
+            interrupted_stream = false;
+        }
+
+        if(job->state == UploadJobState::Recorded || job->state == UploadJobState::Failed || interrupted_stream || !std::filesystem::exists(job->path, ec)){
+            std::filesystem::remove(job->path, ec);
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+
+        std::cout << "Resuming upload job " << job->path << " (" << state_name(job->state) << ")" << std::endl;
+        add_job(job);
+    }
+}
+
+void start_upload_jobs()
+{
+    if(upload_jobs_running){
+        return;
+    }
+
+    upload_jobs_running = true;
+    recover_jobs();
+
+    for(unsigned int i = 0; i < UPLOAD_JOB_WORKERS; i++){
+        upload_pool.workers.emplace_back(worker_loop, std::ref(upload_pool));
+    }
+    for(unsigned int i = 0; i < UPLOAD_STREAMING_JOB_WORKERS; i++){
+        streaming_pool.workers.emplace_back(worker_loop, std::ref(streaming_pool));
+    }
+}
+
+void stop_upload_jobs()
+{
+    {
+        std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+        upload_jobs_running = false;
+    }
+    upload_jobs_cv.notify_all();
+
+    for(JobPool* pool : { &upload_pool, &streaming_pool }){
+        for(auto& worker : pool->workers){
+            if(worker.joinable()){
+                worker.join();
+            }
+        }
+        pool->workers.clear();
+    }
+}
+
+void enqueue_upload_job(const std::string& path, uint32_t session_id, int64_t chat_id, bool streaming)
+{
+    auto job = std::make_shared<UploadJob>();
+    job->path = path;
+    job->session_id = session_id;
+    job->chat_id = chat_id;
+    job->streaming = streaming;
+
+    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+    auto existing = upload_jobs.find(path);
+    if(existing != upload_jobs.end()){
+        // The last chunk arrived while the streaming job is still running: recorded so that a restart
+        // before it finishes sends the complete file instead of dropping it
+        if(!streaming && !existing->second->complete){
+            existing->second->complete = true;
+            persist_job(*existing->second);
+        }
+        return;
+    }
+
+    job->complete = !streaming;
+    add_job(job);
+}
+
+json get_upload_jobs(uint32_t session_id)
+{
+    std::lock_guard<std::mutex> lock(upload_jobs_mutex);
+    json out = json::array();
+
+    for(const auto& [path, job] : upload_jobs){
+        if(job->session_id != session_id){
+            continue;
+        }
+
+        out.push_back({
+            {"file_name", std::filesystem::path(path).filename().string()},
+            {"state", state_name(job->state)},
+            {"size", job->size},
+            {"uploaded", job->uploaded},
+            {"message_id", job->message_id},
+            {"attempts", job->attempts},
+            {"streaming", job->streaming}
+        });
+    }
+
+    return out;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Completed uploads waiting to be sent to Telegram. Jobs are persisted next to
+// the staging file (tmp/<name>.job) and resumed at startup.
+inline constexpr unsigned int UPLOAD_JOB_WORKERS = 4;
+inline constexpr unsigned int UPLOAD_JOBS_PER_SESSION = 2;
+inline constexpr int UPLOAD_JOB_MAX_ATTEMPTS = 3;
+inline constexpr auto UPLOAD_JOB_STALL_TIMEOUT = std::chrono::minutes(5);
+
+// Uploads at least this large are sent to Telegram while their chunks are still arriving.
+// Those jobs wait on the client most of the time, so they run on their own workers.
+inline constexpr bool UPLOAD_PIPELINE_ENABLED = true;
+inline constexpr unsigned int UPLOAD_STREAMING_JOB_WORKERS = 4;
+inline constexpr uint64_t UPLOAD_PIPELINE_MIN_SIZE = 8 * 1024 * 1024;
+inline constexpr const char* UPLOAD_GENERATION_CONVERSION = "archivio_upload";
+inline constexpr auto UPLOAD_PROBE_MAX_WAIT = std::chrono::seconds(15);
+
+// Bytes of out-of-order chunks a streaming job hashes per polling step, so that the content hash
+// (and with it the duplicate check) is ready soon after the last chunk
+inline constexpr uint64_t UPLOAD_HASH_STEP = 64 * 1024 * 1024;
+
+enum class UploadJobState {
+    Pending,
+    Sending,
+    Uploaded,
+    Recorded,
+    Failed
+};
+
+extern void start_upload_jobs();
+extern void stop_upload_jobs();
+extern void enqueue_upload_job(const std::string& path, uint32_t session_id, int64_t chat_id, bool streaming = false);
+extern json get_upload_jobs(uint32_t session_id);
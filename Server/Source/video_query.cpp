@@ -0,0 +1,81 @@
+#include "video_query.hpp"
+#include "db.hpp"
+
+#include <algorithm>
+#include <string>
+
+// Columns from `first` on, in the same format as db_select: every value as a string
+static json row_json(const DbResult& result, const DbRow& row, size_t first)
+{
+    json obj = json::object();
+    for(size_t i = first; i < result.columns.size(); i++){
+        obj[result.columns[i]] = std::holds_alternative<std::nullptr_t>(row[i]) ? "NULL" : db_string(row[i]);
+    }
+    return obj;
+}
+
+// The IN list is padded to a fixed bucket size so the prepared statement is reused across
+// requests of different length.
+bool select_latest_videos(int64_t chat_id, const std::vector<int64_t>& message_ids, std::unordered_map<int64_t, json>& latest)
+{
+    bool ok = true;
+
+    for(size_t first = 0; first < message_ids.size(); first += VIDEOS_DATA_MAX_BATCH){
+        size_t count = std::min(message_ids.size() - first, VIDEOS_DATA_MAX_BATCH);
+        size_t bucket = 8;
+        while(bucket < count){
+            bucket *= 4;
+        }
+        bucket = std::min(bucket, VIDEOS_DATA_MAX_BATCH);
+
+        std::string placeholders = "?";
+        for(size_t i = 1; i < bucket; i++){
+            placeholders += ",?";
+        }
+
+        std::vector<DbValue> params;
+        params.reserve(bucket + 1);
+        params.push_back(chat_id);
+        for(size_t i = 0; i < bucket; i++){
+            params.push_back(message_ids[first + std::min(i, count - 1)]);
+        }
+
+        DbResult result = db_query(
+            "SELECT tv.message_id AS tg_message_id, v.* FROM video v "
+            "JOIN (SELECT tv2.message_id, MAX(v2.id) AS latest_id FROM telegram_video tv2 "
+            "JOIN video v2 ON v2.telegram_video_id = tv2.id "
+            "WHERE tv2.chat_id = ? AND tv2.message_id IN (" + placeholders + ") "
+            "GROUP BY tv2.message_id) tv ON tv.latest_id = v.id;", params);
+
+        if(!result.ok){
+            ok = false;
+            continue;
+        }
+
+        for(const DbRow& row : result.rows){
+            latest[db_int(row[0])] = row_json(result, row, 1);
+        }
+    }
+
+    return ok;
+}
+
+// Keyset pagination on the (chat_id, message_id) unique key: every page is a short range scan
+bool select_chat_videos_page(int64_t chat_id, int64_t before_message_id, std::vector<json>& rows, int64_t& last_message_id)
+{
+    DbResult result = db_query(
+        "SELECT tv.message_id AS message_id, v.* FROM telegram_video tv "
+        "JOIN video v ON v.id = (SELECT MAX(v2.id) FROM video v2 WHERE v2.telegram_video_id = tv.id) "
+        "WHERE tv.chat_id = ? AND tv.message_id < ? ORDER BY tv.message_id DESC LIMIT ?",
+        { chat_id, before_message_id, VIDEOS_DATA_PAGE_ROWS });
+
+    if(!result.ok){
+        return false;
+    }
+
+    for(const DbRow& row : result.rows){
+        rows.push_back(row_json(result, row, 0));
+        last_message_id = db_int(row[0]);
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+using json = nlohmann::json;
+
+// Largest IN list of a single get_videos_data query; longer requests are split
+inline constexpr size_t VIDEOS_DATA_MAX_BATCH = 512;
+
+// Messages per /videos_data page; the connection goes back to the pool between pages
+inline constexpr int64_t VIDEOS_DATA_PAGE_ROWS = 500;
+
+// Latest video row for every message of `message_ids` in one query, keyed by message id, with all
+// values as strings like db_select. False if a batch failed, `latest` then holds only the batches
+// that succeeded.
+extern bool select_latest_videos(int64_t chat_id, const std::vector<int64_t>& message_ids, std::unordered_map<int64_t, json>& latest);
+
+// Up to VIDEOS_DATA_PAGE_ROWS messages of `chat_id` with metadata, newest first and older than
+// `before_message_id`, as the latest video row plus "message_id", all values as strings.
+// `last_message_id` is the cursor for the next page. False on a database error.
+extern bool select_chat_videos_page(int64_t chat_id, int64_t before_message_id, std::vector<json>& rows, int64_t& last_message_id);
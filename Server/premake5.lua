@@ -1,3 +1,8 @@
+newoption {
+    trigger = "sqlite",
+    description = "Keep the metadata in an embedded SQLite database instead of MySQL"
+}
+
 workspace "ArchivioVideo"
     configurations { "Debug", "Release" }
     platforms { "x64" }
@@ -38,7 +43,9 @@ project "ArchivioVideoServer"
             "libssl",
             "libcrypto",
             "avformat",
-            "avutil"
+            "avcodec",
+            "avutil",
+            "swscale"
         }
 
         defines { "TDJSON_STATIC_DEFINE", "TD_ENABLE_STATIC", "TDJSON_STATIC_LIBRARY" }
@@ -59,6 +66,7 @@ project "ArchivioVideoServer"
             "crypto", 
             "avformat", 
             "avcodec", 
+            "swscale",
             "avutil", 
             "swresample",
             "lzma",
@@ -77,6 +85,50 @@ project "ArchivioVideoServer"
             '{COPY} "Dependencies/Linux/td/lib/*" "%{cfg.targetdir}"'
         }
 
+    filter "options:sqlite"
+        defines { "DB_SQLITE" }
+        links { "sqlite3" }
+        removelinks { "libmysql", "mysqlclient" }
+
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        symbols "On"
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+    filter {}
+
+-- Benchmarks of the metadata queries and the upload path (Benchmark/bench.cpp), always on the SQLite backend
+project "ArchivioVideoBench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    targetdir "bin/%{cfg.buildcfg}"
+    objdir "obj/%{cfg.buildcfg}/bench"
+
+    files {
+        "Benchmark/**.cpp", "Benchmark/**.hpp",
+        "Source/db.cpp", "Source/db.hpp",
+        "Source/db_sqlite.cpp",
+        "Source/migrations.cpp", "Source/migrations.hpp",
+        "Source/video_query.cpp", "Source/video_query.hpp",
+        "Source/upload.cpp", "Source/upload.hpp",
+        "Source/staging.cpp", "Source/staging.hpp",
+        "Source/io_engine.cpp", "Source/io_engine.hpp",
+        "Source/crc32c.cpp", "Source/crc32c.hpp"
+    }
+    includedirs { "Source", "Dependencies", "Dependencies/Windows" }
+    defines { "DB_SQLITE" }
+    links { "sqlite3" }
+
+    filter "system:windows"
+        links { "libcrypto" }
+
+    filter "system:linux"
+        links { "crypto", "pthread" }
+
     filter "configurations:Debug"
         defines { "DEBUG" }
         symbols "On"